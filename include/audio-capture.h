@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <vector>
 
 // Base interface for asynchronous audio capture devices
@@ -11,5 +13,31 @@ public:
     virtual bool pause() = 0;
     virtual bool clear() = 0;
     virtual void get(int ms, std::vector<float>& audio) = 0;
+
+    // copy up to n_max samples captured at or after cursor, oldest first, return the count
+    // pos receives the capture index of dst[0], past cursor if samples were lost to an
+    // overrun; cursor moves past the samples returned, so nothing is read twice or skipped
+    virtual size_t read_since(uint64_t& cursor, float* dst, size_t n_max, uint64_t& pos) = 0;
+
+    // zero-copy read_since(): data points at up to n_max contiguous samples inside the
+    // capture buffer, valid until the device laps them, which intact(pos) tells afterwards
+    virtual size_t view_since(uint64_t& cursor, size_t n_max, const float*& data, uint64_t& pos) = 0;
+    virtual bool intact(uint64_t pos) const = 0;
+
+    // samples captured since init(), i.e. the capture index of the next sample
+    virtual uint64_t n_captured() const = 0;
+
+    // sleep until at least ms of audio has been captured since the last clear() or read_since()
+    // returns false if timeout_ms elapsed first
+    virtual bool wait(int ms, int timeout_ms) = 0;
+
+    // filter applied to the samples as they arrive, call between init() and resume()
+    virtual void set_filter(float freq_hp, float pre_emphasis) = 0;
+
+    // number of device periods that overwrote samples before they were read
+    virtual uint64_t n_overruns() const = 0;
+
+    // a finite source (a file) has delivered all of its audio, devices never end
+    virtual bool eof() const { return false; }
 };
 
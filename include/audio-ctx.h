@@ -0,0 +1,38 @@
+#pragma once
+
+#include "whisper.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+//
+// Encoder context sizing
+//
+// The encoder always runs over audio_ctx positions (1500 = 30 s by default), no matter how
+// little audio was passed in. For short windows audio_ctx can be cut down to the audio plus
+// a safety margin. Sizes are rounded up to a few fixed buckets so the backend only ever sees
+// a handful of graph shapes and can keep reusing them.
+//
+
+// --audio-ctx value that selects the bucket per call
+#define AUDIO_CTX_AUTO -1
+
+// encoder positions per second of audio (1500 per 30 s)
+#define AUDIO_CTX_PER_SEC 50
+
+// extra positions past the end of the audio, too tight a context makes the decoder hallucinate
+#define AUDIO_CTX_MARGIN 64
+
+// the buckets in ascending order, the last one (0) is the full context
+const std::vector<int> & audio_ctx_buckets();
+
+// smallest bucket covering n_samples of 16 kHz audio
+int audio_ctx_bucket(size_t n_samples);
+
+// word error rate of hyp against ref, case and punctuation are ignored
+float word_error_rate(const std::string & ref, const std::string & hyp);
+
+// Transcribe the given WAV files in chunks of n_samples_chunk with every bucket that fits
+// each chunk and print the mean encoder time and the WER against the full context per bucket
+bool audio_ctx_bench(whisper_context * ctx, whisper_full_params wparams, const std::vector<std::string> & fnames, int n_samples_chunk);
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "wait-event.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//
+// Lock-free single-producer / single-consumer ring of mono samples
+//
+// The producer is the device callback: write() never blocks, never allocates and never
+// waits on the consumer. It copies into at most two contiguous spans and publishes the new
+// data with a store of a monotonic 64-bit write counter. A producer that converts its input
+// anyway can reserve() the spans and produce straight into them instead. If the consumer has not
+// cleared the ring in time, the oldest unread samples are overwritten and an overrun is
+// counted.
+//
+// The consumer keeps the last `window` samples readable. Since the producer can overwrite
+// samples while they are being copied, reserve() publishes the end of the span it is about to
+// write before it writes, and get() re-checks that position after the copy and discards any
+// prefix that may have been torn (seqlock-style validation), committed or not.
+//
+// A consumer can sleep in wait() until enough samples have arrived. The producer only
+// signals once the requested amount is reached, so there is at most one wake-up per wait.
+//
+// On Linux the storage is one memfd mapped twice back to back, so any run of up to
+// capacity samples is contiguous in memory, wrap or not, and view_since() can hand it out
+// without copying. Elsewhere the first window of the buffer is mirrored past its end on
+// every write, which gives the same contiguous view of up to window samples.
+//
+
+class audio_ring {
+public:
+    audio_ring() = default;
+    ~audio_ring();
+
+    audio_ring(const audio_ring &) = delete;
+    audio_ring & operator=(const audio_ring &) = delete;
+
+    // allocate storage for a window of n_window samples
+    // must be called before the producer is started
+    void init(size_t n_window);
+
+    // producer side (wait-free)
+    void write(const float * data, size_t n);
+
+    // producer side, zero-copy: the ring spans the next n samples (n <= window()) go to
+    // p1 is only used when the span wraps (n1 > 0, never with the double mapping);
+    // fill them in and publish with commit(n)
+    void reserve(size_t n, float *& p0, size_t & n0, float *& p1, size_t & n1);
+    void commit(size_t n);
+
+    // consumer side
+    // get the last min(n, size()) samples
+    void get(size_t n, std::vector<float> & result) const;
+
+    // copy up to n_max samples written at or after cursor, oldest first, return the count
+    // pos receives the absolute index of dst[0]: past cursor if samples were overwritten
+    // before they could be read. cursor moves past the copy, which also counts as read
+    size_t read_since(uint64_t & cursor, float * dst, size_t n_max, uint64_t & pos);
+
+    // zero-copy read_since(): data points into the ring at up to n_max (<= window())
+    // contiguous samples, none of them under a write in progress. They stay valid until the
+    // producer laps them, intact(pos) tells
+    size_t view_since(uint64_t & cursor, size_t n_max, const float *& data, uint64_t & pos);
+
+    // the samples from absolute position pos on have not been overwritten, nor are they being
+    // overwritten by a write in progress
+    bool intact(uint64_t pos) const;
+
+    // the storage is double-mapped (true) or mirrored
+    bool mapped() const { return m_mapped; }
+
+    // samples written since init(), a monotonic 64-bit clock of the stream
+    uint64_t n_written() const { return m_write.load(std::memory_order_acquire); }
+
+    // drop everything written so far
+    void clear();
+
+    // sleep until at least n unread samples are available or timeout_ms elapses
+    bool wait(size_t n, int timeout_ms);
+
+    // number of unread samples, capped at the window size
+    size_t size() const;
+
+    size_t window() const { return m_window; }
+
+    // number of writes that overwrote unread samples, and the total samples lost that way
+    uint64_t n_overruns() const { return m_n_overruns.load(std::memory_order_relaxed); }
+    uint64_t n_dropped()  const { return m_n_dropped.load(std::memory_order_relaxed); }
+
+private:
+    void release();
+
+    // the first window of the storage is copied past its end, when not double-mapped
+    void mirror(uint64_t start, size_t n);
+
+    float * m_data     = nullptr; // power-of-two capacity >= m_window, contiguous past the end
+    size_t  m_capacity = 0;
+    size_t  m_mask     = 0;
+    size_t  m_window   = 0;
+    bool    m_mapped   = false;
+
+    std::vector<float> m_storage; // backing of the mirrored fallback
+
+    std::atomic<uint64_t> m_write{0};    // owned by the producer
+    std::atomic<uint64_t> m_reserved{0}; // end of the span being written, >= m_write
+    std::atomic<uint64_t> m_read{0};  // owned by the consumer
+
+    // write position at which a waiting consumer wants to be woken up
+    std::atomic<uint64_t> m_wake_at{UINT64_MAX};
+    wait_event            m_event;
+
+    std::atomic<uint64_t> m_n_overruns{0};
+    std::atomic<uint64_t> m_n_dropped{0};
+};
+
+// time the producer spends in each 10 ms device callback, with the consumer idle and with it
+// calling get() on the whole window in a loop, against a mutex-guarded buffer doing the same
+void audio_ring_bench(int sample_rate);
+
+// a consumer waiting for 100 ms steps of a device that delivers every 10 ms, sleeping in
+// wait() or polling every millisecond: wake-ups, its CPU time, and how long after the step
+// was complete it got to read it, then the same for a bounded_queue consumer in pop_wait()
+// against pop() every millisecond
+void audio_ring_wait_bench(int sample_rate);
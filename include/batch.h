@@ -0,0 +1,22 @@
+#pragma once
+
+#include "whisper.h"
+
+#include <string>
+#include <vector>
+
+// Offline transcription of audio files
+//
+// Inputs can be files or directories (audio files directly inside are taken in name order).
+// Every file is cut into chunks of at most n_samples_max at the quietest point near the end
+// of each chunk, so no word is split between two chunks. The chunks of all files are
+// transcribed in parallel by n_workers workers, each with its own whisper_state, and the
+// segments are stitched back onto the timeline of their file. ctx should be created without
+// a state. Output goes to stdout and, if fname_out is set, to that file.
+bool batch_transcribe(
+        whisper_context * ctx,
+        const whisper_full_params & wparams,
+        const std::vector<std::string> & inputs,
+        int n_workers,
+        int n_samples_max,
+        const std::string & fname_out);
@@ -0,0 +1,328 @@
+#pragma once
+
+#include "wait-event.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+
+// What the producer does when the queue is full
+enum class queue_overflow {
+    drop_oldest, // evict the oldest queued item to make room
+    drop_newest, // reject the new item
+    block,       // wait for the consumer (up to block_timeout_ms), then reject
+    coalesce,    // merge into a pending item that is flushed as soon as there is room,
+                 // drop_oldest for items that cannot be merged
+};
+
+inline const char * queue_overflow_name(queue_overflow policy) {
+    switch (policy) {
+        case queue_overflow::drop_oldest: return "drop-oldest";
+        case queue_overflow::drop_newest: return "drop-newest";
+        case queue_overflow::block:       return "block";
+        case queue_overflow::coalesce:    return "coalesce";
+    }
+    return "unknown";
+}
+
+inline bool queue_overflow_parse(const std::string & name, queue_overflow & policy) {
+    for (queue_overflow p : { queue_overflow::drop_oldest, queue_overflow::drop_newest, queue_overflow::block, queue_overflow::coalesce }) {
+        if (name == queue_overflow_name(p)) {
+            policy = p;
+            return true;
+        }
+    }
+    return false;
+}
+
+struct queue_stats {
+    uint64_t n_pushed       = 0;
+    uint64_t n_dropped_old  = 0; // drop_oldest evictions
+    uint64_t n_dropped_new  = 0; // drop_newest rejections
+    uint64_t n_block_waits  = 0; // block: pushes that had to wait
+    uint64_t n_block_drops  = 0; // block: pushes rejected after the timeout
+    uint64_t n_coalesced    = 0; // coalesce: items merged into the pending one
+};
+
+// Bounded single-producer single-consumer queue with an explicit overflow policy
+//
+// Every slot carries a sequence number (Vyukov bounded queue), and dequeuing claims a slot
+// with a CAS on the tail. This lets the producer evict the oldest item itself for
+// drop_oldest without racing the consumer, which is what a plain SPSC ring cannot do.
+//
+// Items that had to be thrown away are handed back to the producer through `spill`, so
+// pooled storage can be recycled instead of freed.
+template<typename T>
+class bounded_queue {
+public:
+    // appends src to dst and returns true, or returns false if the two cannot be merged
+    using merge_fn = std::function<bool(T & dst, T & src)>;
+
+    bounded_queue(size_t capacity, queue_overflow policy, int block_timeout_ms = 100, merge_fn merge = nullptr)
+        : m_slots(new slot[capacity]), m_capacity(capacity), m_policy(policy),
+          m_block_timeout_ms(block_timeout_ms), m_merge(std::move(merge)) {
+        for (size_t i = 0; i < m_capacity; ++i) {
+            m_slots[i].seq.store(i, std::memory_order_relaxed);
+        }
+        if (m_policy == queue_overflow::coalesce && !m_merge) {
+            m_policy = queue_overflow::drop_oldest;
+        }
+    }
+
+    //
+    // producer side
+    //
+
+    // enqueue according to the overflow policy
+    // returns true if `spill` received an item the caller should recycle
+    bool push(T && item, T & spill) {
+        if (m_has_pending && !flush()) {
+            // still no room - keep merging into the pending item
+            if (m_merge(m_pending, item)) {
+                bump(m_stats.n_coalesced);
+                spill = std::move(item);
+                return true;
+            }
+
+            // it is full or the new item does not continue it: it takes the place of the
+            // oldest queued item and the new one is pending instead
+            const bool evicted = push_evicting(m_pending, spill);
+            m_pending = std::move(item);
+            return evicted;
+        }
+
+        if (try_push(item)) {
+            return false;
+        }
+
+        switch (m_policy) {
+            case queue_overflow::drop_oldest:
+                {
+                    return push_evicting(item, spill);
+                }
+            case queue_overflow::drop_newest:
+                {
+                    bump(m_stats.n_dropped_new);
+                    spill = std::move(item);
+                    return true;
+                }
+            case queue_overflow::block:
+                {
+                    bump(m_stats.n_block_waits);
+                    const auto t_end = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_block_timeout_ms);
+                    while (true) {
+                        const uint32_t seq = m_space.prepare();
+                        if (try_push(item)) {
+                            return false;
+                        }
+                        const int remaining = (int) std::chrono::duration_cast<std::chrono::milliseconds>(t_end - std::chrono::steady_clock::now()).count();
+                        if (remaining <= 0) {
+                            break;
+                        }
+                        m_space.wait(seq, remaining);
+                    }
+                    bump(m_stats.n_block_drops);
+                    spill = std::move(item);
+                    return true;
+                }
+            case queue_overflow::coalesce:
+                {
+                    m_pending     = std::move(item);
+                    m_has_pending = true;
+                    return false;
+                }
+        }
+
+        return false;
+    }
+
+    // try to enqueue the pending coalesced item, returns true if nothing is pending anymore
+    bool flush() {
+        if (!m_has_pending) {
+            return true;
+        }
+        if (!try_push(m_pending)) {
+            return false;
+        }
+        m_has_pending = false;
+        return true;
+    }
+
+    // flush(), sleeping up to timeout_ms for the consumer to make room, e.g. at the end of a
+    // stream when nothing else will push the pending item out
+    bool flush_wait(int timeout_ms) {
+        const auto t_end = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        while (true) {
+            const uint32_t seq = m_space.prepare();
+            if (flush()) {
+                return true;
+            }
+            const int remaining = (int) std::chrono::duration_cast<std::chrono::milliseconds>(t_end - std::chrono::steady_clock::now()).count();
+            if (remaining <= 0) {
+                return false;
+            }
+            m_space.wait(seq, remaining);
+        }
+    }
+
+    //
+    // consumer side
+    //
+
+    bool pop(T & item) {
+        if (!try_pop(item)) {
+            return false;
+        }
+        m_space.notify();
+        return true;
+    }
+
+    // pop, sleeping up to timeout_ms while the queue is empty
+    // returns false on timeout or when woken by notify() with nothing queued
+    bool pop_wait(T & item, int timeout_ms) {
+        const auto t_end = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        while (true) {
+            const uint32_t seq = m_data.prepare();
+            if (pop(item)) {
+                return true;
+            }
+            const int remaining = (int) std::chrono::duration_cast<std::chrono::milliseconds>(t_end - std::chrono::steady_clock::now()).count();
+            if (remaining <= 0) {
+                return false;
+            }
+            m_data.wait(seq, remaining);
+            if (m_data.prepare() != seq && empty()) {
+                return false; // explicit wake-up, e.g. shutdown
+            }
+        }
+    }
+
+    // wake both ends, e.g. on shutdown
+    void notify() {
+        m_data .notify();
+        m_space.notify();
+    }
+
+    //
+    // either side
+    //
+
+    size_t size() const {
+        const size_t head = m_head.load(std::memory_order_acquire);
+        const size_t tail = m_tail.load(std::memory_order_acquire);
+        return head - std::min(head, tail);
+    }
+
+    bool empty() const { return size() == 0; }
+
+    queue_overflow policy() const { return m_policy; }
+
+    queue_stats stats() const {
+        queue_stats res;
+        res.n_pushed      = m_stats.n_pushed     .load(std::memory_order_relaxed);
+        res.n_dropped_old = m_stats.n_dropped_old.load(std::memory_order_relaxed);
+        res.n_dropped_new = m_stats.n_dropped_new.load(std::memory_order_relaxed);
+        res.n_block_waits = m_stats.n_block_waits.load(std::memory_order_relaxed);
+        res.n_block_drops = m_stats.n_block_drops.load(std::memory_order_relaxed);
+        res.n_coalesced   = m_stats.n_coalesced  .load(std::memory_order_relaxed);
+        return res;
+    }
+
+private:
+    struct slot {
+        std::atomic<size_t> seq;
+        T item;
+    };
+
+    // counters are only ever written by the producer
+    struct atomic_stats {
+        std::atomic<uint64_t> n_pushed     {0};
+        std::atomic<uint64_t> n_dropped_old{0};
+        std::atomic<uint64_t> n_dropped_new{0};
+        std::atomic<uint64_t> n_block_waits{0};
+        std::atomic<uint64_t> n_block_drops{0};
+        std::atomic<uint64_t> n_coalesced  {0};
+    };
+
+    static void bump(std::atomic<uint64_t> & counter) {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    // producer only - the item is left untouched on failure
+    bool try_push(T & item) {
+        const size_t pos = m_head.load(std::memory_order_relaxed);
+        slot & s = m_slots[pos % m_capacity];
+        if (s.seq.load(std::memory_order_acquire) != pos) {
+            return false; // full, or the consumer is still reading this slot
+        }
+        s.item = std::move(item);
+        s.seq.store(pos + 1, std::memory_order_release);
+        m_head.store(pos + 1, std::memory_order_release);
+        bump(m_stats.n_pushed);
+        m_data.notify();
+        return true;
+    }
+
+    // producer only - makes room by evicting the oldest item into spill if needed
+    // returns true if it did
+    bool push_evicting(T & item, T & spill) {
+        bool evicted = false;
+        while (!try_push(item)) {
+            // the consumer may be in the middle of reading the slot we need - then there is room already
+            if (size() < m_capacity) {
+                std::this_thread::yield();
+                continue;
+            }
+            if (!evicted && try_pop(spill)) {
+                bump(m_stats.n_dropped_old);
+                evicted = true;
+            }
+        }
+        return evicted;
+    }
+
+    // consumer, or producer evicting the oldest item
+    bool try_pop(T & item) {
+        size_t pos = m_tail.load(std::memory_order_relaxed);
+        while (true) {
+            slot & s = m_slots[pos % m_capacity];
+            const size_t seq = s.seq.load(std::memory_order_acquire);
+            if (seq == pos + 1) {
+                if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_acq_rel, std::memory_order_relaxed)) {
+                    item = std::move(s.item);
+                    s.seq.store(pos + m_capacity, std::memory_order_release);
+                    return true;
+                }
+            } else if (seq < pos + 1) {
+                return false; // empty
+            } else {
+                pos = m_tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    std::unique_ptr<slot[]> m_slots;
+    size_t m_capacity;
+
+    std::atomic<size_t> m_head{0};
+    std::atomic<size_t> m_tail{0};
+
+    queue_overflow m_policy;
+    int            m_block_timeout_ms;
+    merge_fn       m_merge;
+
+    // producer-owned coalescing buffer
+    T    m_pending{};
+    bool m_has_pending = false;
+
+    wait_event m_data;  // signalled on push
+    wait_event m_space; // signalled on pop
+
+    atomic_stats m_stats;
+};
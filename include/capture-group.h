@@ -0,0 +1,133 @@
+#pragma once
+
+#include "audio-capture.h"
+#include "chunker.h"
+#include "echo-cancel.h"
+#include "session-manager.h"
+#include "vad-stream.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Several capture sources transcribed side by side, e.g. the microphone (the local speaker)
+// and the system loopback (the remote side of a meeting)
+//
+// Every source keeps its own capture ring. The group reads each ring in place with
+// view_since(), runs it through its own vad_stream and silence_chunker and queues the
+// chunks into its own session of one session_manager, so the model weights and the worker
+// pool are shared but the speakers are never mixed. Nothing is buffered or copied beyond
+// what the single-source loop does. While no source has a full step, the group sleeps on
+// the capture notification of the one closest to it.
+//
+// The sources are put on one sample clock at start(): group position 0 is the capture index
+// every source had at that moment, read back to back. Device clocks still drift apart by
+// tens of ppm, the drift of each source against the first one is measured and reported.
+//
+// With speakers the microphone also picks up the remote side, which the loopback already
+// transcribes. The microphone can be given the loopback as echo reference: its steps go
+// through an echo_canceller before the VAD, and chunks that are still mostly explained by
+// the reference are dropped instead of being transcribed a second time.
+class capture_group {
+public:
+    // sources are read every step_ms, speech is cut into chunks of about chunk_ms
+    capture_group(const vad_stream_params & vparams, int step_ms, int chunk_ms, int chunk_tol_ms, int chunk_max_ms);
+
+    // an initialized source and the VAD backend it is gated with, label tags its results
+    // returns the index of the source
+    size_t add(const std::string & label, std::unique_ptr<audio_capture> audio, std::unique_ptr<vad_backend> vad);
+
+    // cancel the echo of source i_ref in source i_mic, and drop the chunks of i_mic of which
+    // more than max_share of the energy is explained by i_ref (1 keeps all), before start()
+    void set_echo_reference(size_t i_mic, size_t i_ref, echo_params params, float max_share);
+
+    // one session per source, in the order they were added, then every source is resumed
+    bool start(session_manager & sessions);
+
+    // read every source until keep_going() returns false or all of them ended, queue what is
+    // still pending and wait for the sessions to finish it
+    void run(session_manager & sessions, const std::function<bool()> & keep_going);
+
+    size_t size() const { return m_sources.size(); }
+
+    // label of the source transcribed by session id
+    const std::string & label(int id) const;
+
+    void print_stats() const;
+
+private:
+    struct source {
+        std::string                    label;
+        std::unique_ptr<audio_capture> audio;
+        std::unique_ptr<vad_stream>    vad;
+        std::unique_ptr<silence_chunker> chunker;
+
+        int session = -1;
+
+        // echo cancellation against another source, see set_echo_reference()
+        int                             ref    = -1; // the source that is the reference of this one
+        int                             ref_of = -1; // the source this one is the reference of
+        std::unique_ptr<echo_canceller> aec;
+        float                           echo_max_share = 1.0f;
+
+        // of a reference: the audio the other source has not cancelled against yet, in a ring
+        // of a few steps that is written twice (at i and i + n_history), so any span of it is
+        // contiguous; a stalled microphone does not hold on to more than that
+        std::vector<float> history;
+        size_t             n_history   = 0;
+        int64_t            history_pos = 0; // group positions [history_pos, history_end) are kept
+        int64_t            history_end = 0;
+
+        uint64_t base   = 0; // capture index at group position 0
+        uint64_t cursor = 0;
+        int64_t  offset = 0; // maps VAD positions to capture indices, grows when samples are lost
+
+        bool done = false;
+
+        uint64_t n_lost   = 0;
+        uint64_t n_torn   = 0;
+        uint64_t n_chunks = 0;
+
+        uint64_t n_echo_chunks  = 0; // dropped by the echo gate
+        uint64_t n_echo_samples = 0;
+        uint64_t n_ref_missing  = 0; // reference samples that were not there in time
+    };
+
+    // one step of source s if it has one, returns false if there was nothing to read
+    bool step(source & s, session_manager & sessions);
+
+    // queue the finished chunks of s, minus those the echo gate drops
+    void emit(source & s, session_manager & sessions);
+
+    // a reference source keeps the step at group position pos for the source it serves
+    void keep_reference(source & r, const float * data, size_t n, int64_t pos);
+
+    // the reference of s for the n samples at capture index pos of s, silence where it is missing
+    const float * reference(source & s, uint64_t pos, size_t n);
+
+    vad_stream_params m_vparams;
+    int               m_step_ms;
+    int               m_chunk_ms;
+    int               m_chunk_tol_ms;
+    int               m_chunk_max_ms;
+    size_t            m_n_step;
+
+    std::vector<source> m_sources;
+
+    std::vector<vad_event> m_events;
+    std::vector<float>     m_speech;
+    std::vector<float>     m_ref;   // reference of one step, when parts of it are missing
+    std::vector<float>     m_clean; // one step with the echo removed
+
+    std::chrono::steady_clock::time_point m_t_start;
+    std::vector<uint64_t>                 m_n_end; // capture index of every source when run() ended
+    double                                m_t_run = 0.0;
+};
+
+// the label results of a capture source are tagged with: "mic" -> "local",
+// "system" -> "remote", a file -> its name without directory and extension
+std::string capture_group_label(const std::string & name);
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "sample-pool.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// Backlog of captured audio waiting for inference
+//
+// Audio that piles up while whisper is busy is handed out oldest-first in windows of at
+// most n_window samples, so a single whisper_full call never sees more than the model can
+// take (30 s). When the lag grows past n_deadline samples the oldest audio can be skipped
+// so the stream gets back to real-time. n_deadline = 0 never skips.
+class catchup_buffer {
+public:
+    catchup_buffer(size_t n_window, size_t n_deadline);
+
+    void push(const float * data, size_t n);
+
+    // pending samples
+    size_t size()  const { return m_data.size() - m_pos; }
+    bool   empty() const { return size() == 0; }
+
+    // a full window is pending, no need to wait for more audio
+    bool full() const { return size() >= m_n_window; }
+
+    // the next window to process, call consume() once it is done
+    const float * window()      const { return m_data.data() + m_pos; }
+    size_t        window_size() const { return size() < m_n_window ? size() : m_n_window; }
+
+    void consume(size_t n);
+
+    // absolute position of window() in the stream of samples pushed so far
+    uint64_t position() const { return m_n_read; }
+
+    // n_lag is the total audio behind real-time, including what is still queued upstream
+    // records the lag and returns true if it is past the deadline
+    bool behind(size_t n_lag);
+
+    // drop the oldest pending samples so that at most n_keep remain, returns the number dropped
+    size_t skip(size_t n_keep);
+
+    size_t   n_window()   const { return m_n_window; }
+    uint64_t n_windows()  const { return m_n_windows; }
+    uint64_t n_skipped()  const { return m_n_skipped; }
+    size_t   n_max_lag()  const { return m_n_max_lag; }
+
+private:
+    pcm_block m_data;
+    size_t    m_pos = 0; // start of the pending samples in m_data
+
+    size_t m_n_window;
+    size_t m_n_deadline;
+
+    uint64_t m_n_read    = 0; // samples consumed or skipped
+    uint64_t m_n_windows = 0;
+    uint64_t m_n_skipped = 0;
+    size_t   m_n_max_lag = 0;
+};
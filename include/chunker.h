@@ -0,0 +1,61 @@
+#pragma once
+
+#include "sample-pool.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <utility>
+
+// start of the quietest whole frame (n_frame samples) in x[begin..end), ties go to the later
+// frame, begin if none fits; energy receives its sum of squares if not null
+size_t chunk_find_quiet(const float * x, size_t begin, size_t end, size_t n_frame, double * energy = nullptr);
+
+// Cuts a stream of audio into chunks that end in pauses
+//
+// A chunk is cut at the quietest 10 ms frame within tolerance of the target length. If that
+// frame is not clearly quieter than its surroundings (someone is talking through the whole
+// window), the search widens up to the maximum length, where the cut is forced. Every chunk
+// carries the absolute offset of its first sample in the capture stream.
+class silence_chunker {
+public:
+    silence_chunker(int sample_rate, int target_ms, int tolerance_ms, int max_ms);
+
+    // start a new stretch of audio at absolute position pos, pending audio becomes a chunk
+    void begin(int64_t pos);
+
+    // append samples that follow the previous ones
+    void push(const float * samples, size_t n);
+
+    // the pending audio becomes a chunk, e.g. at the end of a speech region
+    void flush();
+
+    bool ready() const { return !m_spans.empty(); }
+
+    // next finished chunk, its samples are copied into out
+    bool pop(pcm_block & out, int64_t & pos);
+
+    // most samples a chunk can have
+    size_t n_max() const { return m_n_max; }
+
+    uint64_t n_chunks() const { return m_n_chunks; }
+    uint64_t n_forced() const { return m_n_forced; }
+
+private:
+    void cut(size_t n);
+
+    size_t m_n_frame;
+    size_t m_n_target;
+    size_t m_n_tolerance;
+    size_t m_n_max;
+
+    pcm_block m_pending;
+    int64_t   m_pos = 0; // absolute position of m_pending[0]
+
+    // finished chunks as (position, samples) spans of m_done
+    pcm_block                                  m_done;
+    std::deque<std::pair<int64_t, size_t>> m_spans;
+
+    uint64_t m_n_chunks = 0;
+    uint64_t m_n_forced = 0;
+};
@@ -6,9 +6,10 @@
 #include <atomic>
 #include <cstdint>
 #include <vector>
-#include <mutex>
 
 #include "audio-capture.h"
+#include "audio-ring.h"
+#include "resample.h"
 
 //
 // SDL Audio capture
@@ -33,18 +34,34 @@ public:
     // get audio data from the circular buffer
     void get(int ms, std::vector<float> & audio) override;
 
+    // new samples since cursor, straight from the ring
+    size_t read_since(uint64_t & cursor, float * dst, size_t n_max, uint64_t & pos) override { return m_ring.read_since(cursor, dst, n_max, pos); }
+
+    size_t view_since(uint64_t & cursor, size_t n_max, const float *& data, uint64_t & pos) override { return m_ring.view_since(cursor, n_max, data, pos); }
+    bool intact(uint64_t pos) const override { return m_ring.intact(pos); }
+
+    uint64_t n_captured() const override { return m_ring.n_written(); }
+
+    // block until ms of audio is available, woken by the SDL callback
+    bool wait(int ms, int timeout_ms) override;
+
+    void set_filter(float freq_hp, float pre_emphasis) override { m_convert.set_filter(freq_hp, pre_emphasis); }
+
+    uint64_t n_overruns() const override { return m_ring.n_overruns(); }
+
 private:
     SDL_AudioDeviceID m_dev_id_in = 0;
 
     int m_len_ms = 0;
-    int m_sample_rate = 0;
+    int m_sample_rate = 0; // of the samples in the ring, the device may run at another rate
 
     std::atomic_bool m_running;
-    std::mutex       m_mutex;
 
-    std::vector<float> m_audio;
-    size_t             m_audio_pos = 0;
-    size_t             m_audio_len = 0;
+    // written by the SDL audio thread, read by get()
+    audio_ring m_ring;
+
+    // device format to mono at m_sample_rate, only touched by the SDL audio thread while running
+    capture_convert m_convert;
 };
 
 // Return false if need to quit
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "fft.h"
+
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct echo_params {
+    int   sample_rate = 16000;
+    int   block       = 128;   // samples per block, the transforms are twice as long
+    int   tail_ms     = 256;   // longest echo path covered, device offset included
+    float mu          = 0.5f;  // NLMS step size, 0 < mu < 2
+    int   history_ms  = 30000; // how far back echo_share() can look
+};
+
+// Acoustic echo canceller for the microphone, with the system loopback as reference
+//
+// Partitioned-block frequency-domain NLMS (MDF): the echo path is modelled by tail_ms/block
+// partitions of one block each, filtered and adapted per frequency bin with overlap-save, so
+// a block costs five real FFTs of twice the block size plus two multiply-adds per bin and
+// partition. The step is normalized by the reference power over the span of the filter and
+// slowed down by the smoothed error power, so double talk (both sides speaking at once) does
+// not pull the filter off. One partition per block is constrained back to a linear
+// convolution, round robin.
+//
+// The mic and the reference must be on the same sample clock, e.g. a capture_group; whatever
+// offset remains between the two devices is part of the echo path and has to fit in the tail.
+class echo_canceller {
+public:
+    explicit echo_canceller(const echo_params & params);
+
+    // mic[0..n) and ref[0..n) are aligned, out receives the mic with the echo removed for
+    // every whole block and the count is returned; up to block - 1 samples are held back for
+    // the next call, so the output always lines up with the mic input
+    size_t process(const float * mic, const float * ref, size_t n, float * out);
+
+    // share of the mic energy in output samples [pos, pos + n) that the reference explains,
+    // from the correlation of the mic with the echo estimate per block, in [0, 1]
+    float echo_share(int64_t pos, size_t n) const;
+
+    int n_partitions() const { return m_n_part; }
+
+    // output samples produced so far
+    int64_t position() const { return (int64_t) m_n_blocks*m_n; }
+
+    void reset();
+
+private:
+    void block(const float * mic, const float * ref, float * out);
+
+    // mic energy, mic times echo estimate and echo estimate energy of one block
+    struct block_stats {
+        float dd;
+        float dy;
+        float yy;
+    };
+
+    int m_n;      // block size
+    int m_n_part; // partitions
+    float m_mu;
+
+    fft_real m_fft;
+
+    std::vector<float> m_x; // reference of the previous and the current block
+
+    // reference spectra of the last n_part blocks, m_i_x is the newest, and the filter
+    std::vector<std::complex<float>> m_X; // [n_part][block + 1]
+    std::vector<std::complex<float>> m_W; // [n_part][block + 1]
+    int                              m_i_x = 0;
+    int                              m_i_constrain = 0;
+
+    std::vector<float> m_px; // reference power per bin over the span of the filter
+    std::vector<float> m_pe; // smoothed error power per bin
+
+    std::vector<std::complex<float>> m_Y;
+    std::vector<std::complex<float>> m_E;
+    std::vector<float>               m_y;
+    std::vector<float>               m_e;
+
+    // input of the block being filled
+    std::vector<float> m_mic_hold;
+    std::vector<float> m_ref_hold;
+    size_t             m_n_hold = 0;
+
+    // per-block statistics of the last history_ms, indexed by block number
+    std::vector<block_stats> m_stats;
+    uint64_t                 m_n_blocks = 0;
+};
+
+// ERLE (echo return loss enhancement) and echo share of the canceller on a simulated room,
+// for a few tail lengths, with and without double talk, and the share of one core it takes
+// per stream
+void echo_canceller_bench(int sample_rate);
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <complex>
+#include <vector>
+
+//
+// Mixed-radix FFT with precomputed twiddles
+//
+// Sizes are factored into radix 4, 2 and small odd primes, so whisper's n_fft = 400 works as
+// well as powers of two. Plans keep their own scratch space: create one per thread.
+//
+
+// complex forward transform of size n
+class fft_plan {
+public:
+    explicit fft_plan(int n);
+
+    int size() const { return m_n; }
+
+    void forward(const std::complex<float> * in, std::complex<float> * out);
+
+private:
+    void work(std::complex<float> * out, const std::complex<float> * in, int fstride, const int * factors) const;
+
+    int m_n;
+
+    std::vector<std::complex<float>> m_twiddles; // exp(-2*pi*i*k/n)
+    std::vector<int>                 m_factors;  // (radix, remaining length) pairs
+};
+
+// real forward transform of even size n, computed as a complex transform of size n/2
+class fft_real {
+public:
+    explicit fft_real(int n);
+
+    int size()   const { return m_n; }
+    int n_bins() const { return m_n/2 + 1; }
+
+    // out receives n/2 + 1 bins
+    void forward(const float * in, std::complex<float> * out);
+
+    // |X[k]|^2 for k = 0 .. n/2
+    void power(const float * in, float * out);
+
+    // n real samples from the n/2 + 1 bins of forward(), scaled so inverse(forward(x)) = x
+    void inverse(const std::complex<float> * in, float * out);
+
+private:
+    int m_n;
+
+    fft_plan m_half;
+
+    std::vector<std::complex<float>> m_twiddles; // exp(-2*pi*i*k/n), k = 0 .. n/2
+    std::vector<std::complex<float>> m_packed;
+    std::vector<std::complex<float>> m_spectrum;
+    std::vector<std::complex<float>> m_bins;
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "audio-capture.h"
+#include "audio-ring.h"
+#include "resample.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+//
+// Audio capture replayed from a file, for running the live pipeline without sound hardware
+//
+// Audio files are decoded up front with read_audio_data(). "-" reads raw 16-bit mono PCM at
+// the pipeline rate from stdin, and so does a path ending in .raw or .pcm. A thread hands the
+// samples to the ring in 10 ms periods, as a device callback would:
+//
+//   speed = 1  real time
+//   speed = N  N times real time
+//   speed = 0  as fast as the consumer reads, the ring is never overrun
+//
+// jitter_ms delays each period by a random amount up to jitter_ms, periods that were held
+// back are delivered in a burst once their deadline passes, like a late device callback.
+//
+class file_audio_capture : public audio_capture {
+public:
+    file_audio_capture(int len_ms, const std::string & fname, float speed = 1.0f, int jitter_ms = 0);
+    ~file_audio_capture();
+
+    bool init(int capture_id, int sample_rate) override;
+    bool resume() override;
+    bool pause() override;
+    bool clear() override;
+    void get(int ms, std::vector<float> & audio) override;
+    bool wait(int ms, int timeout_ms) override;
+    size_t read_since(uint64_t & cursor, float * dst, size_t n_max, uint64_t & pos) override { return m_ring.read_since(cursor, dst, n_max, pos); }
+    size_t view_since(uint64_t & cursor, size_t n_max, const float *& data, uint64_t & pos) override { return m_ring.view_since(cursor, n_max, data, pos); }
+    bool intact(uint64_t pos) const override { return m_ring.intact(pos); }
+    uint64_t n_captured() const override { return m_ring.n_written(); }
+    void set_filter(float freq_hp, float pre_emphasis) override { m_convert.set_filter(freq_hp, pre_emphasis); }
+    uint64_t n_overruns() const override { return m_ring.n_overruns(); }
+    bool eof() const override { return m_eof.load(std::memory_order_acquire); }
+
+private:
+    void run();
+
+    // next block of the source at the source rate, returns 0 at the end
+    size_t read(float * dst, size_t n);
+
+    std::string m_fname;
+    float       m_speed;
+    int         m_jitter_ms;
+
+    int m_len_ms      = 0;
+    int m_sample_rate = 0;
+
+    // decoded file, or the pipe raw PCM is read from
+    std::vector<float>   m_pcm;
+    size_t               m_pos  = 0;
+    FILE *               m_pipe = nullptr;
+    std::vector<int16_t> m_raw;
+
+    std::thread      m_thread;
+    std::atomic_bool m_running;
+    std::atomic_bool m_eof;
+
+    audio_ring      m_ring;
+    capture_convert m_convert;
+};
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+
+// Capture-side conditioning filter: 2nd-order high-pass followed by optional pre-emphasis
+//
+// Runs once on every block as it arrives from the device, in place, with its state carried
+// from one block to the next, so everything downstream (VAD and inference) reads filtered
+// samples without another pass. The high-pass is an RBJ biquad (Butterworth, Q = 1/sqrt(2))
+// in transposed direct form II: two state variables, five multiplies per sample.
+class capture_filter {
+public:
+    // freq_hp <= 0 disables the high-pass, pre_emphasis = 0 disables the pre-emphasis
+    capture_filter(float sample_rate = 16000.0f, float freq_hp = 0.0f, float pre_emphasis = 0.0f);
+
+    void process(float * samples, size_t n);
+
+    // forget the state, e.g. after a device restart
+    void reset();
+
+    bool enabled() const { return m_hp || m_pre != 0.0f; }
+
+private:
+    bool  m_hp;
+    float m_b0, m_b1, m_b2, m_a1, m_a2;
+    float m_z1 = 0.0f;
+    float m_z2 = 0.0f;
+
+    float m_pre;
+    float m_x_prev = 0.0f;
+};
+
+// Average n_channels interleaved channels of n_frames frames into out
+// Stereo, the loopback default, has SSE2 / NEON paths; in and out must not overlap.
+void capture_downmix(const float * in, size_t n_frames, int n_channels, float * out);
+
+// time capture_filter against high_pass_filter() from common, prints samples per second
+void capture_filter_bench(int sample_rate, float freq_hp);
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A decoded token with its position in the audio stream (absolute sample offsets)
+struct stream_token {
+    int32_t     id = 0;
+    int64_t     t0 = 0;
+    int64_t     t1 = 0;
+    std::string text;
+};
+
+// LocalAgreement-2 commit policy for streaming transcription
+//
+// Every step re-transcribes the audio that has not been committed yet. Tokens that two
+// consecutive hypotheses agree on (longest common prefix) are committed and never decoded
+// again: their text is emitted once, their ids become the prompt for the next step and the
+// audio they cover can be trimmed from the window.
+class local_agreement {
+public:
+    explicit local_agreement(size_t n_max_prompt = 224);
+
+    // feed the hypothesis of the current step, returns the tokens that became stable
+    std::vector<stream_token> update(const std::vector<stream_token> & hyp);
+
+    // commit whatever is still pending, e.g. at the end of an utterance
+    std::vector<stream_token> flush();
+
+    // forget the pending hypothesis and the prompt, keep the committed position
+    void reset();
+
+    // unconfirmed tail of the last hypothesis
+    const std::vector<stream_token> & pending() const { return m_pending; }
+
+    // the most recent committed token ids, to be used as prompt
+    const std::vector<int32_t> & prompt() const { return m_prompt; }
+
+    // absolute sample position where the committed text ends
+    int64_t committed_end() const { return m_committed_end; }
+
+    uint64_t n_committed() const { return m_n_committed; }
+
+private:
+    void commit(const stream_token * tokens, size_t n);
+
+    size_t m_n_max_prompt;
+
+    std::vector<stream_token> m_pending;
+    std::vector<int32_t>      m_prompt;
+
+    int64_t  m_committed_end = 0;
+    uint64_t m_n_committed   = 0;
+};
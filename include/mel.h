@@ -0,0 +1,83 @@
+#pragma once
+
+#include "spectrum.h"
+
+#include <cstdint>
+#include <vector>
+
+//
+// Whisper-compatible log-mel front-end
+//
+// Mirrors whisper's log_mel_spectrogram(): 25 ms periodic Hann window, 10 ms hop, slaney
+// mel filters, log10 with a 1e-10 floor, clamped to (max - 8) and scaled as (x + 4)/4.
+// The input is reflect-padded by half a window at the start and zero-padded by 30 s at the
+// end, so the result can be handed to whisper_set_mel() as is.
+//
+
+#define WHISPER_MEL_N_FFT 400
+#define WHISPER_MEL_HOP   160
+
+struct mel_filterbank {
+    int n_mel  = 0;
+    int n_bins = 0; // n_fft/2 + 1
+
+    std::vector<float> data;  // [n_mel][n_bins]
+    std::vector<int>   begin; // first non-zero bin per mel band
+    std::vector<int>   end;   // one past the last non-zero bin per mel band
+};
+
+// librosa.filters.mel(sr, n_fft, n_mels, htk=False, norm="slaney"), which is what the
+// filters stored in whisper models were generated with
+mel_filterbank mel_filterbank_slaney(int n_mel, int n_fft, int sample_rate);
+
+// how many of the n_take samples before absolute position pos to put in front of a window so
+// that it starts on a hop boundary and its frames can be taken from a mel_cache; a window that
+// cannot start on one (n_take too short) gets none of them and misses the cache
+int mel_align_take(int64_t pos, int n_take);
+
+// Rolling cache of log-mel frames keyed by absolute sample position
+//
+// In the sliding-window loop consecutive windows overlap, so most frames of a window were
+// already computed the step before. Frames that lie entirely inside the audio are cached by
+// their absolute hop index; only frames over new audio and the few frames touching the
+// padded edges are computed again. Per-step cost scales with the new audio, not the window.
+class mel_cache {
+public:
+    mel_cache(int n_mel, int sample_rate, int n_max_frames);
+
+    // spectrogram of samples[0..n) in whisper's [n_mel][n_len] layout, returns n_len
+    // pos is the absolute position of samples[0], frames are only reused if it is a multiple of the hop
+    int compute(const float * samples, int n, int64_t pos, std::vector<float> & out);
+
+    int n_mel() const { return m_filters.n_mel; }
+
+    uint64_t n_computed() const { return m_n_computed; }
+    uint64_t n_reused()   const { return m_n_reused;   }
+
+private:
+    // raw log10 mel energies of one 400-sample frame
+    void frame(const float * x, float * dst);
+
+    mel_filterbank m_filters;
+    power_spectrum m_spectrum;
+
+    int m_n_pad_end; // 30 s of zeros
+
+    std::vector<float> m_power;
+    std::vector<float> m_edge;
+    std::vector<float> m_col;
+
+    // ring of cached frames, m_tags holds the absolute frame index stored in each slot
+    int                  m_n_max_frames;
+    std::vector<float>   m_frames;
+    std::vector<int64_t> m_tags;
+
+    uint64_t m_n_computed = 0;
+    uint64_t m_n_reused   = 0;
+};
+
+// time per sliding-window step of the log-mel front-end with and without the frame cache, for
+// a few step sizes and both mel band counts, and the largest difference between the two; the
+// steps are not multiples of the hop and the windows are built with mel_align_take() as in
+// the stream loop
+void mel_cache_bench(int sample_rate);
@@ -18,7 +18,7 @@ public:
     bool connect();
 
     // send a chunk of PCM audio (float samples in [-1,1])
-    bool send_audio(const std::vector<float> &audio);
+    bool send_audio(const float *audio, size_t n_samples);
 
     // receive a transcript message, returns false if no message available
     bool receive_transcript(std::string &text);
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "audio-ring.h"
+#include "filter.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Streaming polyphase resampler for a rational ratio rate_out/rate_in = L/M
+//
+// The Kaiser-windowed sinc prototype is sampled once into L phases of n_taps() taps, so
+// every output sample is a single dot product over contiguous input (SSE2 / NEON). The
+// cutoff sits at 0.45 of the lower rate. Output sample j lines up with input time j*M/L,
+// there is no group delay to compensate; the only latency is the n_taps()/2 samples of
+// lookahead. Input can come in blocks of any size.
+class resampler {
+public:
+    // n_zeros: zero crossings of the sinc on each side, more is sharper and slower
+    resampler(int rate_in = 16000, int rate_out = 16000, int n_zeros = 32);
+
+    // resamples in[0..n) into out, returns the number of samples written (<= max_out(n))
+    size_t process(const float * in, size_t n, float * out);
+
+    size_t max_out(size_t n) const { return (size_t) ((n*(uint64_t) m_l)/m_m) + 1; }
+
+    bool passthrough() const { return m_l == m_m; }
+
+    int n_taps() const { return m_n_taps; }
+
+    void reset();
+
+private:
+    int m_l;
+    int m_m;
+    int m_half;   // taps on each side of the output position
+    int m_n_taps; // 2*m_half, padded to a multiple of 8
+
+    std::vector<float> m_taps; // [m_l][m_n_taps]
+
+    std::vector<float> m_buf; // history plus the input not consumed yet
+    uint64_t           m_t;   // position of the next output in m_buf, in 1/L input samples
+};
+
+// Conversion from the device format to what the pipeline reads, run in the capture callback:
+// downmix to mono, resample to the pipeline rate, filter, write to the ring. A device that
+// already runs at the pipeline rate is downmixed and filtered straight into the ring spans.
+// Nothing is allocated after init().
+class capture_convert {
+public:
+    void init(int rate_in, int n_channels, int rate_out);
+
+    void set_filter(float freq_hp, float pre_emphasis);
+
+    void process(const float * input, size_t n_frames, audio_ring & ring);
+
+    int rate_in()    const { return m_rate_in; }
+    int rate_out()   const { return m_rate_out; }
+    int n_channels() const { return m_n_channels; }
+
+private:
+    int m_rate_in    = 16000;
+    int m_rate_out   = 16000;
+    int m_n_channels = 1;
+
+    resampler      m_resampler;
+    capture_filter m_filter;
+
+    std::vector<float> m_mono; // one block of downmixed device frames
+    std::vector<float> m_out;  // the same block at the pipeline rate
+};
+
+// quality and cost of the resampler from common device rates to rate_out, against linear
+// interpolation: SNR of a band-limited test signal, level of an out-of-band tone folded back
+// into the output, and the share of one core a single stream takes
+void resampler_bench(int rate_out);
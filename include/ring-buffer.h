@@ -0,0 +1,45 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Single-producer single-consumer ring buffer
+//
+// push() and pop() never block, a full or empty buffer is reported instead
+template<typename T>
+class RingBuffer {
+public:
+    explicit RingBuffer(size_t capacity)
+        : m_buffer(capacity + 1), m_head(0), m_tail(0) {}
+
+    bool push(T&& item) {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        size_t next = (head + 1) % m_buffer.size();
+        if (next == m_tail.load(std::memory_order_acquire)) {
+            return false; // full
+        }
+        m_buffer[head] = std::move(item);
+        m_head.store(next, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& item) {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_head.load(std::memory_order_acquire)) {
+            return false; // empty
+        }
+        item = std::move(m_buffer[tail]);
+        m_tail.store((tail + 1) % m_buffer.size(), std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const {
+        return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+    }
+
+private:
+    std::vector<T> m_buffer;
+    std::atomic<size_t> m_head;
+    std::atomic<size_t> m_tail;
+};
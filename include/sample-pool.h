@@ -0,0 +1,92 @@
+#pragma once
+
+#include "ring-buffer.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+//
+// Preallocated sample blocks for the capture -> inference pipeline
+//
+
+// raw 64-byte aligned storage, every call is counted by pcm_n_allocs()
+void *   pcm_aligned_alloc(size_t n_bytes, size_t alignment);
+void     pcm_aligned_free(void * ptr);
+uint64_t pcm_n_allocs();
+
+template<typename T, size_t Align = 64>
+struct aligned_allocator {
+    using value_type = T;
+    using is_always_equal = std::true_type;
+
+    template<typename U> struct rebind { using other = aligned_allocator<U, Align>; };
+
+    aligned_allocator() = default;
+    template<typename U> aligned_allocator(const aligned_allocator<U, Align> &) {}
+
+    T * allocate(size_t n) {
+        void * ptr = pcm_aligned_alloc(n*sizeof(T), Align);
+        if (ptr == nullptr) {
+            throw std::bad_alloc();
+        }
+        return static_cast<T *>(ptr);
+    }
+
+    void deallocate(T * ptr, size_t) {
+        pcm_aligned_free(ptr);
+    }
+
+    template<typename U> bool operator==(const aligned_allocator<U, Align> &) const { return true;  }
+    template<typename U> bool operator!=(const aligned_allocator<U, Align> &) const { return false; }
+};
+
+// cache-line aligned PCM buffer
+using pcm_block = std::vector<float, aligned_allocator<float, 64>>;
+
+// a block of captured audio and where it starts in the capture stream
+struct pcm_chunk {
+    pcm_block pcm;
+    int64_t   pos = -1; // capture index of the first sample, -1 for markers
+
+    std::chrono::steady_clock::time_point t_ready; // when it was queued for inference
+};
+
+// append src to dst if it continues dst directly and the result still fits in n_max samples,
+// the merge function of a coalescing audio queue; markers are never merged
+bool pcm_chunk_merge(pcm_chunk & dst, const pcm_chunk & src, size_t n_max);
+
+// Fixed set of blocks travelling producer -> consumer -> producer
+//
+// The producer takes empty blocks with acquire(), fills them and hands them to the consumer
+// through the audio queue. The consumer gives them back with release() once the samples are
+// copied out. Both ends are single-threaded, the free list is an SPSC ring in the reverse
+// direction, so in steady state no heap allocation happens on either side.
+class pcm_pool {
+public:
+    pcm_pool(size_t n_blocks, size_t n_samples);
+
+    // producer side - falls back to a new block if all of them are in flight
+    pcm_block acquire();
+
+    // producer side - keep a block the producer got back without it reaching the consumer
+    // (e.g. evicted from a full queue), it is handed out again by the next acquire()
+    void reclaim(pcm_block && block);
+
+    // consumer side - the block keeps its capacity, surplus blocks are freed
+    void release(pcm_block && block);
+
+private:
+    RingBuffer<pcm_block> m_free;
+    size_t                m_n_samples;
+
+    pcm_block m_spare; // producer-owned
+};
+
+// a producer queueing chunks 8x faster than the consumer takes them, with markers and gaps, for
+// every overflow policy: what is dropped or merged, whether every sample still sits at its
+// capture position, the largest chunk and the heap allocations once warmed up
+void pcm_queue_stress(int sample_rate);
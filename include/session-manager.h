@@ -0,0 +1,118 @@
+#pragma once
+
+#include "sample-pool.h"
+#include "whisper.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// A transcribed segment of one session, t0/t1 are absolute sample offsets in its stream
+struct session_result {
+    int         id = -1;
+    int64_t     t0 = 0;
+    int64_t     t1 = 0;
+    std::string text;
+
+    double t_latency_ms = 0.0; // from push() to the result
+};
+
+// per session, counted once per chunk whether or not it produced any segments
+struct session_stats {
+    uint64_t n_jobs           = 0;
+    uint64_t n_samples        = 0;
+    double   t_infer_ms       = 0.0; // whisper_full_with_state, summed over the chunks
+    double   t_latency_max_ms = 0.0; // from push() to the end of its inference
+};
+
+using session_callback = std::function<void(const session_result &)>;
+
+// Many audio streams transcribed with one set of model weights
+//
+// The context is created once with whisper_init_from_file_with_params_no_state() and every
+// session gets its own whisper_state (KV cache, compute buffers, decoded segments). A fixed
+// pool of workers runs whisper_full_with_state() on whichever sessions have audio queued.
+// Chunks of a session are processed in order and never by two workers at once, chunks of
+// different sessions run in parallel. Chunks travel in pcm_blocks that come back to the
+// manager once processed and are handed out again by acquire(), so a steady stream of chunks
+// does not allocate.
+class session_manager {
+public:
+    session_manager(whisper_context * ctx, const whisper_full_params & wparams, int n_workers, session_callback callback);
+    ~session_manager();
+
+    // new session with its own state, returns its id or -1 if the state could not be created
+    int open();
+
+    // the state is freed once the queued chunks of the session are done
+    void close(int id);
+
+    // an empty block to fill with the next chunk, one that was processed already if there is
+    // one, and the way to give back a block that was not pushed after all
+    pcm_block acquire();
+    void      release(pcm_block && block);
+
+    // queue the next chunk of the stream
+    bool push(int id, pcm_block && samples);
+
+    // queue a chunk that starts at absolute position pos of the stream, for streams with gaps
+    // (only speech is pushed), results are timed from pos; pos < 0 continues the stream
+    bool push(int id, pcm_block && samples, int64_t pos);
+
+    // block until every queued chunk has been processed
+    void drain();
+
+    // what the chunks processed so far took, e.g. after drain()
+    session_stats stats(int id);
+
+    int n_workers() const { return (int) m_workers.size(); }
+
+private:
+    struct job {
+        pcm_block samples;
+        int64_t   pos; // absolute position of samples[0]
+        std::chrono::steady_clock::time_point t_push;
+    };
+
+    struct session {
+        whisper_state *  state = nullptr;
+        std::deque<job>  jobs;
+        session_stats    stats;
+        int64_t          n_pushed = 0;
+        bool             busy     = false;
+        bool             closed   = false;
+    };
+
+    void worker();
+
+    whisper_context *   m_ctx;
+    whisper_full_params m_wparams;
+    session_callback    m_callback;
+
+    std::mutex              m_mutex;
+    std::condition_variable m_cv_work;
+    std::condition_variable m_cv_idle;
+
+    std::vector<std::unique_ptr<session>> m_sessions; // indexed by id
+    std::deque<int>                       m_ready;    // sessions with queued chunks and no worker
+    size_t                                m_n_jobs = 0; // queued or running
+    std::vector<pcm_block>                m_free;       // processed blocks, for acquire()
+    bool                                  m_stop   = false;
+
+    std::vector<std::thread> m_workers;
+};
+
+// resident memory of the process in bytes, 0 if unknown
+size_t process_memory_bytes();
+
+// Replay the WAV files as concurrent real-time streams, one session each, in chunks of
+// n_samples_chunk and report the aggregate real-time factor and the memory per session
+bool session_replay(whisper_context * ctx, const whisper_full_params & wparams, const std::vector<std::string> & fnames, int n_workers, int n_samples_chunk);
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "fft.h"
+
+#include <vector>
+
+//
+// Short-time power spectrum front-end
+//
+// One periodic Hann-windowed frame of n_fft samples to n_fft/2 + 1 power bins, on top of the
+// real FFT. With n_fft = 400 and a 160 sample hop these are exactly the frames whisper's
+// log-mel is built from, so the VAD and the mel cache share the same front-end.
+//
+
+class power_spectrum {
+public:
+    explicit power_spectrum(int n_fft);
+
+    int n_fft()  const { return m_fft.size(); }
+    int n_bins() const { return m_fft.n_bins(); }
+
+    // |FFT(hann * x[0..n_fft))|^2, out receives n_bins() values
+    void compute(const float * x, float * out);
+
+    // sum of the window squared, sum(power)/(n_fft*window_sq/2) is the mean square of the frame
+    float window_sq() const { return m_window_sq; }
+
+private:
+    fft_real m_fft;
+
+    std::vector<float> m_hann;
+    std::vector<float> m_windowed;
+
+    float m_window_sq = 0.0f;
+};
+
+// Band features of one power spectrum
+struct spectral_features {
+    float energy;   // mean square of the frame
+    float speech;   // share of the energy in the 300 - 3400 Hz band
+    float flatness; // geometric over arithmetic mean of the speech band, 1 for white noise
+};
+
+// band layout for a given spectrum size and sample rate
+class spectral_bands {
+public:
+    spectral_bands(int n_fft, int sample_rate);
+
+    spectral_features compute(const float * power, float window_sq) const;
+
+private:
+    int m_n_fft;
+    int m_n_bins;
+    int m_k_lo; // first bin of the speech band
+    int m_k_hi; // one past the last
+};
@@ -1,10 +1,11 @@
 #pragma once
 
 #include "audio-capture.h"
+#include "audio-ring.h"
+#include "resample.h"
 #include "miniaudio.h"
 
 #include <atomic>
-#include <mutex>
 #include <vector>
 
 //
@@ -20,17 +21,22 @@ public:
     bool pause() override;
     bool clear() override;
     void get(int ms, std::vector<float>& audio) override;
+    bool wait(int ms, int timeout_ms) override;
+    size_t read_since(uint64_t& cursor, float* dst, size_t n_max, uint64_t& pos) override { return m_ring.read_since(cursor, dst, n_max, pos); }
+    size_t view_since(uint64_t& cursor, size_t n_max, const float*& data, uint64_t& pos) override { return m_ring.view_since(cursor, n_max, data, pos); }
+    bool intact(uint64_t pos) const override { return m_ring.intact(pos); }
+    uint64_t n_captured() const override { return m_ring.n_written(); }
+    void set_filter(float freq_hp, float pre_emphasis) override { m_convert.set_filter(freq_hp, pre_emphasis); }
+    uint64_t n_overruns() const override { return m_ring.n_overruns(); }
 
     void callback(const float* input, ma_uint32 frame_count);
 
 private:
     ma_device m_device{};
     int m_len_ms = 0;
-    int m_sample_rate = 0;
+    int m_sample_rate = 0; // of the samples in the ring, the device runs at its own rate
     std::atomic_bool m_running;
-    std::mutex m_mutex;
-    std::vector<float> m_audio;
-    size_t m_audio_pos = 0;
-    size_t m_audio_len = 0;
+    audio_ring m_ring;
+    capture_convert m_convert;
 };
 
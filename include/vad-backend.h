@@ -0,0 +1,147 @@
+#pragma once
+
+#include "vad.h"
+#include "spectrum.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct whisper_vad_context;
+
+struct vad_backend_params {
+    int   sample_rate = 16000;
+    float vad_thold   = 0.6f;
+    float freq_thold  = 100.0f;
+
+    // silero
+    std::string model;
+    int         n_threads = 1;
+};
+
+// Frame classifier behind vad_stream
+//
+// classify() gets whole 10 ms frames, in blocks of any number of frames, and is called with
+// consecutive audio, so backends may keep context between calls.
+class vad_backend {
+public:
+    virtual ~vad_backend() {}
+
+    virtual const char * name() const = 0;
+
+    // one flag per 10 ms frame of samples[0..n), n is a multiple of the frame size
+    virtual void classify(const float * samples, size_t n, std::vector<uint8_t> & active) = 0;
+};
+
+// per-frame energy and zero-crossing rate against the fixed -40 dB threshold (vad_frame_activity)
+class vad_backend_fixed : public vad_backend {
+public:
+    explicit vad_backend_fixed(const vad_backend_params & params);
+
+    const char * name() const override { return "fixed"; }
+    void classify(const float * samples, size_t n, std::vector<uint8_t> & active) override;
+
+private:
+    int m_sample_rate;
+};
+
+// per-frame energy and zero-crossing rate relative to the tracked noise floor
+//
+// The audio is high-passed at freq_thold first (unless it is 0 because the capture filter
+// did it already), so rumble does not lift the floor. A frame
+// needs vad_thold*20 dB over the floor (12 dB at the default 0.6).
+class vad_backend_energy : public vad_backend {
+public:
+    explicit vad_backend_energy(const vad_backend_params & params);
+
+    const char * name() const override { return "energy"; }
+    void classify(const float * samples, size_t n, std::vector<uint8_t> & active) override;
+
+    float noise_floor() const { return m_floor.value(); }
+
+private:
+    int   m_sample_rate;
+    float m_margin; // power ratio over the floor
+
+    // one-pole high-pass
+    float m_alpha;
+    float m_x_prev = 0.0f;
+    float m_y_prev = 0.0f;
+
+    vad_noise_floor        m_floor;
+    std::vector<float>     m_work;
+    std::vector<vad_frame> m_frames;
+};
+
+// Band energies and spectral flatness of whisper's 25 ms / 10 ms STFT frames
+//
+// A frame is speech if the 300 - 3400 Hz band carries most of its energy, that band is not
+// flat (hiss and fan noise are), and the band energy is vad_thold*20 dB over its noise floor.
+// Rumble and hum fail the band test, broadband noise the flatness test.
+class vad_backend_spectral : public vad_backend {
+public:
+    explicit vad_backend_spectral(const vad_backend_params & params);
+
+    const char * name() const override { return "spectral"; }
+    void classify(const float * samples, size_t n, std::vector<uint8_t> & active) override;
+
+    // cost of the front-end and of the whole classifier per frame, in ns
+    static void bench(int sample_rate);
+
+private:
+    size_t m_n_frame;
+    float  m_margin;
+
+    power_spectrum  m_spectrum;
+    spectral_bands  m_bands;
+    vad_noise_floor m_floor;
+
+    std::vector<float> m_history; // the n_fft - hop samples before the current frame
+    std::vector<float> m_work;
+    std::vector<float> m_power;
+};
+
+// vad_simple() from common: the block is speech unless it is quieter than vad_thold times
+// the average of the last 2 s, after a freq_thold high-pass. Decides per block, not per frame.
+class vad_backend_simple : public vad_backend {
+public:
+    explicit vad_backend_simple(const vad_backend_params & params);
+
+    const char * name() const override { return "simple"; }
+    void classify(const float * samples, size_t n, std::vector<uint8_t> & active) override;
+
+private:
+    vad_backend_params m_params;
+
+    size_t             m_n_history;
+    std::vector<float> m_history;
+    std::vector<float> m_work;
+};
+
+// Silero model through whisper_vad_*, on its own single-threaded CPU context. A block is
+// evaluated in one whisper_vad_detect_speech() call, prefixed by the end of the previous
+// block since the model state is reset on every call.
+class vad_backend_silero : public vad_backend {
+public:
+    explicit vad_backend_silero(const vad_backend_params & params);
+    ~vad_backend_silero() override;
+
+    bool ok() const { return m_vctx != nullptr; }
+
+    const char * name() const override { return "silero"; }
+    void classify(const float * samples, size_t n, std::vector<uint8_t> & active) override;
+
+private:
+    whisper_vad_context * m_vctx = nullptr;
+
+    float  m_thold;
+    size_t m_n_frame;
+
+    std::vector<float> m_context; // tail of the previous block
+    std::vector<float> m_work;
+};
+
+// "energy", "fixed", "spectral", "simple" or "silero", nullptr if unknown or the model failed to load
+std::unique_ptr<vad_backend> vad_backend_create(const std::string & name, const vad_backend_params & params);
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "vad-backend.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct vad_event {
+    enum type_t {
+        speech_start,
+        speech_end,
+    };
+
+    type_t  type;
+    int64_t pos;      // absolute sample offset in the fed stream
+    size_t  i_speech; // samples of the speech output of feed() that come before the event
+};
+
+struct vad_stream_params {
+    int sample_rate      = 16000;
+    int pre_roll_ms      = 300; // audio before the onset that is forwarded with the speech
+    int hangover_ms      = 500; // non-speech kept in the region before it ends
+    int min_speech_ms    = 200; // active audio needed before a region starts
+};
+
+// Streaming voice activity detection on 10 ms frames
+//
+// Frames are classified by a vad_backend, the energy one if none is given.
+// Samples are fed incrementally, in any block size. A region starts once min_speech_ms of
+// active frames were seen without a gap longer than the hangover, and ends after hangover_ms
+// without activity. Only the samples of a region, starting pre_roll_ms before its first
+// active frame, are returned for inference, so onsets that straddle two blocks are kept
+// and silence never reaches the encoder.
+class vad_stream {
+public:
+    explicit vad_stream(const vad_stream_params & params, std::unique_ptr<vad_backend> backend = nullptr);
+
+    // appends region boundaries to events and the samples to forward to speech
+    void feed(const float * samples, size_t n, std::vector<vad_event> & events, std::vector<float> & speech);
+
+    // most samples a single feed() of n samples can return
+    size_t max_forward(size_t n) const { return n + m_n_pre_roll + m_n_min_speech + m_n_hangover + m_n_frame; }
+
+    const char * backend_name() const { return m_backend->name(); }
+
+    // backend decision for each frame of the last feed() that had whole frames
+    const std::vector<uint8_t> & active() const { return m_active; }
+
+    bool in_speech() const { return m_state == state_speech; }
+
+    int64_t  position()    const { return m_pos; }
+    uint64_t n_forwarded() const { return m_n_forwarded; }
+    uint64_t n_regions()   const { return m_n_regions; }
+
+private:
+    enum state_t {
+        state_silence,
+        state_pending, // active frames seen, not enough for a region yet
+        state_speech,
+    };
+
+    void frame(const float * x, bool active, std::vector<vad_event> & events, std::vector<float> & speech);
+
+    std::unique_ptr<vad_backend> m_backend;
+
+    size_t m_n_frame;
+    size_t m_n_pre_roll;
+    size_t m_n_hangover;
+    size_t m_n_min_speech;
+
+    state_t m_state = state_silence;
+
+    std::vector<float> m_frames; // whole frames of the current feed(), plus the remainder carried over
+
+    // samples not forwarded yet: the pre-roll, plus the pending region
+    std::vector<float> m_hold;
+    int64_t            m_hold_pos = 0;
+
+    size_t m_n_active = 0; // active samples of the pending region
+    size_t m_n_gap    = 0; // inactive samples since the last active frame
+
+    int64_t  m_pos         = 0; // samples fed
+    uint64_t m_n_forwarded = 0;
+    uint64_t m_n_regions   = 0;
+
+    std::vector<uint8_t> m_active;
+};
+
+// Run every named backend through a vad_stream over the WAV files and print, per backend,
+// the share of audio forwarded, the number of regions per minute and the CPU time per second
+// of audio. On recordings without speech every region is a false trigger.
+//
+// A file "x.wav" may come with "x.lab" (Audacity labels, "start end" in seconds per speech
+// region). For labeled files the share of speech that lands in a forwarded region and the
+// precision and recall of the per-frame backend decisions are printed as well.
+bool vad_compare(const std::vector<std::string> & fnames, const std::vector<std::string> & backends,
+                 const vad_backend_params & bparams, const vad_stream_params & sparams);
@@ -1,7 +1,58 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <vector>
 
+// Features of one 10 ms frame, the last frame of a buffer may be shorter
+struct vad_frame {
+    float energy;      // mean square
+    int   n_crossings; // zero crossings, including the one into the frame from the previous sample
+    int   n_samples;
+};
+
+// Energy and zero crossings of every 10 ms frame in one pass. Uses the widest SIMD kernel
+// the CPU supports (AVX2, SSE2, NEON or scalar), picked at runtime.
+void vad_frames(const float * samples, size_t n, int sample_rate, std::vector<vad_frame> & frames);
+
+// the zero-crossing rate of the frame is in the voiced range and its energy reaches energy_th
+bool vad_frame_voiced(const vad_frame & frame, float energy_th);
+
+// 1 for every 10 ms frame that looks like speech, against a fixed energy threshold (-40 dB)
+void vad_frame_activity(const float * samples, size_t n, int sample_rate, std::vector<uint8_t> & active);
+
+// Noise floor from minimum statistics
+//
+// Frame energies are smoothed over a few frames and the floor is the minimum over the last
+// n_windows windows of n_frames frames, scaled up by the usual bias of a minimum. Speech
+// rarely lasts a whole span (5 s by default) without a pause, so the floor follows the
+// background and not the talker, and rises within one span when the room gets louder.
+class vad_noise_floor {
+public:
+    explicit vad_noise_floor(int n_frames = 50, int n_windows = 10);
+
+    // feed the energy of the next frame, returns the current floor
+    float update(float energy);
+
+    float value() const { return m_floor; }
+
+private:
+    int m_n_frames;
+    int m_n_in_window = 0;
+    int m_i_window    = 0;
+
+    float m_smooth  = -1.0f;
+    float m_cur_min;
+    float m_floor   = 0.0f;
+
+    std::vector<float> m_mins;
+};
+
+// name of the kernel used by vad_frames()
+const char * vad_kernel_name();
+
+// time every kernel available on this CPU on synthetic audio, prints ns per second of audio
+void vad_bench(int sample_rate);
+
 // Returns true if the given PCM audio contains human speech.
 bool vad_detect_speech(const std::vector<float> &pcmf32, int sample_rate);
-
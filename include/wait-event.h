@@ -0,0 +1,35 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+//
+// Futex-style event for sleeping until another thread signals progress
+//
+// Uses WaitOnAddress on Windows and futex(2) on Linux. notify() costs a single atomic
+// increment unless a thread is actually blocked, so it is cheap enough to call from an
+// audio callback.
+//
+// Usage (no lost wakeups):
+//
+//   const uint32_t seq = ev.prepare();
+//   if (!condition()) {
+//       ev.wait(seq, timeout_ms);
+//   }
+//
+
+class wait_event {
+public:
+    uint32_t prepare() const { return m_seq.load(std::memory_order_acquire); }
+
+    // sleep until notify() is called after prepare() returned seq, or until timeout_ms elapses
+    // may return early, callers re-check their condition
+    void wait(uint32_t seq, int timeout_ms);
+
+    // wake all waiters
+    void notify();
+
+private:
+    std::atomic<uint32_t> m_seq{0};
+    std::atomic<uint32_t> m_n_waiters{0};
+};
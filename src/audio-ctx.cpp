@@ -0,0 +1,152 @@
+#include "audio-ctx.h"
+
+#include "common-whisper.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <sstream>
+
+const std::vector<int> & audio_ctx_buckets() {
+    static const std::vector<int> buckets = { 256, 384, 512, 768, 1024, 0 };
+    return buckets;
+}
+
+static int audio_ctx_needed(size_t n_samples) {
+    return (int) ((n_samples*AUDIO_CTX_PER_SEC + WHISPER_SAMPLE_RATE - 1)/WHISPER_SAMPLE_RATE) + AUDIO_CTX_MARGIN;
+}
+
+int audio_ctx_bucket(size_t n_samples) {
+    const int n_needed = audio_ctx_needed(n_samples);
+    for (int b : audio_ctx_buckets()) {
+        if (b == 0 || b >= n_needed) {
+            return b;
+        }
+    }
+    return 0;
+}
+
+static std::vector<std::string> split_words(const std::string & text) {
+    std::string clean;
+    clean.reserve(text.size());
+    for (unsigned char c : text) {
+        if (c < 0x80 && std::ispunct(c)) {
+            continue;
+        }
+        clean += (char) (c < 0x80 ? std::tolower(c) : c);
+    }
+
+    std::vector<std::string> words;
+    std::istringstream ss(clean);
+    std::string w;
+    while (ss >> w) {
+        words.push_back(w);
+    }
+    return words;
+}
+
+float word_error_rate(const std::string & ref, const std::string & hyp) {
+    const std::vector<std::string> r = split_words(ref);
+    const std::vector<std::string> h = split_words(hyp);
+
+    if (r.empty()) {
+        return h.empty() ? 0.0f : 1.0f;
+    }
+
+    // word-level edit distance, one row at a time
+    std::vector<size_t> prev(h.size() + 1), cur(h.size() + 1);
+    for (size_t j = 0; j <= h.size(); ++j) {
+        prev[j] = j;
+    }
+    for (size_t i = 1; i <= r.size(); ++i) {
+        cur[0] = i;
+        for (size_t j = 1; j <= h.size(); ++j) {
+            const size_t sub = prev[j - 1] + (r[i - 1] == h[j - 1] ? 0 : 1);
+            cur[j] = std::min({ sub, prev[j] + 1, cur[j - 1] + 1 });
+        }
+        prev.swap(cur);
+    }
+
+    return float(prev[h.size()])/r.size();
+}
+
+static bool bench_run(whisper_context * ctx, whisper_full_params wparams, const float * samples, int n, std::string & text, float & t_encode_ms) {
+    whisper_reset_timings(ctx);
+    if (whisper_full(ctx, wparams, samples, n) != 0) {
+        return false;
+    }
+
+    whisper_timings * timings = whisper_get_timings(ctx);
+    t_encode_ms = timings ? timings->encode_ms : 0.0f;
+    delete timings;
+
+    text.clear();
+    const int n_segments = whisper_full_n_segments(ctx);
+    for (int i = 0; i < n_segments; ++i) {
+        text += whisper_full_get_segment_text(ctx, i);
+    }
+    return true;
+}
+
+bool audio_ctx_bench(whisper_context * ctx, whisper_full_params wparams, const std::vector<std::string> & fnames, int n_samples_chunk) {
+    const std::vector<int> & buckets = audio_ctx_buckets();
+
+    std::vector<int>    n_runs(buckets.size(), 0);
+    std::vector<double> t_encode(buckets.size(), 0.0);
+    std::vector<double> wer(buckets.size(), 0.0);
+
+    for (const auto & fname : fnames) {
+        std::vector<float> pcmf32;
+        std::vector<std::vector<float>> pcmf32s;
+        if (!read_audio_data(fname, pcmf32, pcmf32s, false)) {
+            fprintf(stderr, "%s: failed to read '%s'\n", __func__, fname.c_str());
+            return false;
+        }
+
+        for (size_t off = 0; off < pcmf32.size(); off += n_samples_chunk) {
+            const int n = (int) std::min(pcmf32.size() - off, (size_t) n_samples_chunk);
+
+            // the full context is the reference
+            std::string ref;
+            float t_ms = 0.0f;
+            wparams.audio_ctx = 0;
+            if (!bench_run(ctx, wparams, pcmf32.data() + off, n, ref, t_ms)) {
+                fprintf(stderr, "%s: failed to process '%s'\n", __func__, fname.c_str());
+                return false;
+            }
+            n_runs.back()++;
+            t_encode.back() += t_ms;
+
+            const int n_needed = audio_ctx_needed(n);
+            for (size_t b = 0; b + 1 < buckets.size(); ++b) {
+                if (buckets[b] < n_needed) {
+                    continue;
+                }
+
+                std::string hyp;
+                wparams.audio_ctx = buckets[b];
+                if (!bench_run(ctx, wparams, pcmf32.data() + off, n, hyp, t_ms)) {
+                    fprintf(stderr, "%s: failed to process '%s'\n", __func__, fname.c_str());
+                    return false;
+                }
+                n_runs[b]++;
+                t_encode[b] += t_ms;
+                wer[b]      += word_error_rate(ref, hyp);
+            }
+        }
+    }
+
+    printf("\n%s: %d files, chunks of %.1f sec\n\n", __func__, (int) fnames.size(), float(n_samples_chunk)/WHISPER_SAMPLE_RATE);
+    printf("%10s %8s %8s %12s %8s\n", "audio_ctx", "max sec", "chunks", "encode ms", "WER");
+    for (size_t b = 0; b < buckets.size(); ++b) {
+        if (n_runs[b] == 0) {
+            continue;
+        }
+        const int n_ctx = buckets[b] > 0 ? buckets[b] : whisper_model_n_audio_ctx(ctx);
+        printf("%10d %8.1f %8d %12.2f %7.2f%%\n",
+                n_ctx, float(n_ctx - AUDIO_CTX_MARGIN)/AUDIO_CTX_PER_SEC, n_runs[b],
+                t_encode[b]/n_runs[b], 100.0*wer[b]/n_runs[b]);
+    }
+
+    return true;
+}
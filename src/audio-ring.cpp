@@ -0,0 +1,547 @@
+#include "audio-ring.h"
+#include "bounded-queue.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+
+#if defined(__linux__)
+#include <ctime>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// n_bytes of memory mapped twice back to back, nullptr if the kernel does not let us
+static float * ring_map(size_t n_bytes) {
+    const int fd = (int) syscall(SYS_memfd_create, "audio_ring", 0);
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    void * base = MAP_FAILED;
+    if (ftruncate(fd, (off_t) n_bytes) == 0) {
+        // reserve the address range first so both halves land next to each other
+        base = mmap(nullptr, 2*n_bytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+    if (base != MAP_FAILED) {
+        char * lo = (char *) base;
+        if (mmap(lo,           n_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+            mmap(lo + n_bytes, n_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+            munmap(base, 2*n_bytes);
+            base = MAP_FAILED;
+        }
+    }
+
+    // the mappings keep the memory alive
+    close(fd);
+
+    return base == MAP_FAILED ? nullptr : (float *) base;
+}
+
+static void ring_unmap(float * data, size_t n_bytes) {
+    munmap(data, 2*n_bytes);
+}
+#else
+static float * ring_map(size_t /*n_bytes*/) {
+    return nullptr;
+}
+
+static void ring_unmap(float * /*data*/, size_t /*n_bytes*/) {
+}
+#endif
+
+// CPU time of the calling thread in seconds, 0 where it is not available
+static double ring_thread_cpu_seconds() {
+#if defined(_WIN32)
+    FILETIME t_create, t_exit, t_kernel, t_user;
+    if (!GetThreadTimes(GetCurrentThread(), &t_create, &t_exit, &t_kernel, &t_user)) {
+        return 0.0;
+    }
+    const uint64_t kernel = ((uint64_t) t_kernel.dwHighDateTime << 32) | t_kernel.dwLowDateTime;
+    const uint64_t user   = ((uint64_t) t_user  .dwHighDateTime << 32) | t_user  .dwLowDateTime;
+    return 1e-7*double(kernel + user);
+#elif defined(__linux__)
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) {
+        return 0.0;
+    }
+    return double(ts.tv_sec) + 1e-9*double(ts.tv_nsec);
+#else
+    return 0.0;
+#endif
+}
+
+audio_ring::~audio_ring() {
+    release();
+}
+
+void audio_ring::release() {
+    if (m_mapped) {
+        ring_unmap(m_data, m_capacity*sizeof(float));
+    }
+    m_storage.clear();
+    m_storage.shrink_to_fit();
+
+    m_data     = nullptr;
+    m_capacity = 0;
+    m_mapped   = false;
+}
+
+void audio_ring::init(size_t n_window) {
+    release();
+
+    // whole pages, so the storage can be mapped twice
+    size_t capacity = 1024;
+    while (capacity < n_window) {
+        capacity <<= 1;
+    }
+
+    m_data = ring_map(capacity*sizeof(float));
+    if (m_data) {
+        m_mapped = true;
+    } else {
+        m_storage.assign(capacity + n_window, 0.0f);
+        m_data = m_storage.data();
+    }
+
+    m_capacity = capacity;
+    m_mask     = capacity - 1;
+    m_window   = n_window;
+
+    m_write   .store(0, std::memory_order_relaxed);
+    m_reserved.store(0, std::memory_order_relaxed);
+    m_read    .store(0, std::memory_order_relaxed);
+
+    m_n_overruns.store(0, std::memory_order_relaxed);
+    m_n_dropped .store(0, std::memory_order_relaxed);
+}
+
+void audio_ring::write(const float * data, size_t n) {
+    if (m_window == 0 || n == 0) {
+        return;
+    }
+
+    // only the most recent window can ever be read back
+    if (n > m_window) {
+        data += n - m_window;
+        n     = m_window;
+    }
+
+    float * p0;
+    float * p1;
+    size_t  n0;
+    size_t  n1;
+    reserve(n, p0, n0, p1, n1);
+
+    memcpy(p0, data,      n0*sizeof(float));
+    memcpy(p1, data + n0, n1*sizeof(float));
+
+    commit(n);
+}
+
+void audio_ring::reserve(size_t n, float *& p0, size_t & n0, float *& p1, size_t & n1) {
+    const uint64_t w   = m_write.load(std::memory_order_relaxed);
+    const size_t   pos = w & m_mask;
+
+    // published before any of the span is touched, a reader that copied from it sees this
+    m_reserved.store(w + n, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    n0 = m_mapped ? n : std::min(n, m_capacity - pos);
+    n1 = n - n0;
+    p0 = m_data + pos;
+    p1 = m_data;
+}
+
+void audio_ring::mirror(uint64_t start, size_t n) {
+    // the part of [start, start + n) that falls into the first window of the storage
+    const size_t pos = start & m_mask;
+    if (pos + n > m_capacity) {
+        const size_t n_wrap = std::min(pos + n - m_capacity, m_window);
+        memcpy(m_data + m_capacity, m_data, n_wrap*sizeof(float));
+    }
+    if (pos < m_window) {
+        const size_t n_head = std::min(n, m_window - pos);
+        memcpy(m_data + m_capacity + pos, m_data + pos, n_head*sizeof(float));
+    }
+}
+
+void audio_ring::commit(size_t n) {
+    const uint64_t w = m_write.load(std::memory_order_relaxed);
+    const uint64_t r = m_read .load(std::memory_order_acquire);
+
+    // unread samples that fall out of the window are lost
+    const uint64_t unread = std::min<uint64_t>(w - std::min(r, w), m_window);
+    if (unread + n > m_window) {
+        const uint64_t lost = unread + n - m_window;
+
+        m_n_overruns.store(m_n_overruns.load(std::memory_order_relaxed) + 1,    std::memory_order_relaxed);
+        m_n_dropped .store(m_n_dropped .load(std::memory_order_relaxed) + lost, std::memory_order_relaxed);
+    }
+
+    if (!m_mapped) {
+        mirror(w, n);
+    }
+
+    m_write.store(w + n, std::memory_order_seq_cst);
+
+    if (w + n >= m_wake_at.load(std::memory_order_seq_cst)) {
+        m_wake_at.store(UINT64_MAX, std::memory_order_relaxed);
+        m_event.notify();
+    }
+}
+
+void audio_ring::get(size_t n, std::vector<float> & result) const {
+    const uint64_t w0 = m_write.load(std::memory_order_acquire);
+    const uint64_t r  = m_read .load(std::memory_order_relaxed);
+
+    n = std::min<size_t>(n, std::min<uint64_t>(w0 - std::min(r, w0), m_window));
+
+    result.resize(n);
+    if (n == 0) {
+        return;
+    }
+
+    // contiguous across the wrap, either mapped or mirrored
+    const uint64_t start = w0 - n;
+    memcpy(result.data(), m_data + (start & m_mask), n*sizeof(float));
+
+    // the producer may have lapped the oldest part of the copy in the meantime, or be
+    // writing over it right now
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const uint64_t w1 = m_reserved.load(std::memory_order_relaxed);
+
+    if (w1 - start > m_capacity) {
+        const size_t n_torn = std::min<uint64_t>(n, w1 - start - m_capacity);
+        result.erase(result.begin(), result.begin() + n_torn);
+    }
+}
+
+size_t audio_ring::read_since(uint64_t & cursor, float * dst, size_t n_max, uint64_t & pos) {
+    const uint64_t w0 = m_write.load(std::memory_order_acquire);
+
+    // anything older than one window may already be overwritten
+    uint64_t start = std::max(cursor, w0 - std::min<uint64_t>(w0, m_window));
+    start = std::min(start, w0);
+
+    size_t n = std::min<uint64_t>(w0 - start, n_max);
+    if (n > 0) {
+        memcpy(dst, m_data + (start & m_mask), n*sizeof(float));
+
+        // same validation as get(): drop the prefix the producer may have lapped
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const uint64_t w1 = m_reserved.load(std::memory_order_relaxed);
+
+        if (w1 - start > m_capacity) {
+            const size_t n_torn = std::min<uint64_t>(n, w1 - start - m_capacity);
+            memmove(dst, dst + n_torn, (n - n_torn)*sizeof(float));
+            start += n_torn;
+            n     -= n_torn;
+        }
+    }
+
+    pos    = start;
+    cursor = start + n;
+    m_read.store(std::max(cursor, m_read.load(std::memory_order_relaxed)), std::memory_order_release);
+
+    return n;
+}
+
+size_t audio_ring::view_since(uint64_t & cursor, size_t n_max, const float *& data, uint64_t & pos) {
+    const uint64_t w        = m_write.load(std::memory_order_acquire);
+    const uint64_t reserved = std::max(w, m_reserved.load(std::memory_order_acquire));
+
+    // nothing the producer is writing over right now is handed out
+    uint64_t start = std::max({ cursor, w - std::min<uint64_t>(w, m_window), reserved - std::min<uint64_t>(reserved, m_capacity) });
+    start = std::min(start, w);
+
+    const size_t n = std::min<uint64_t>({ w - start, n_max, m_window });
+
+    data   = m_data + (start & m_mask);
+    pos    = start;
+    cursor = start + n;
+    m_read.store(std::max(cursor, m_read.load(std::memory_order_relaxed)), std::memory_order_release);
+
+    return n;
+}
+
+bool audio_ring::intact(uint64_t pos) const {
+    // the reads of the caller come before the check
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return m_reserved.load(std::memory_order_relaxed) - pos <= m_capacity;
+}
+
+void audio_ring::clear() {
+    m_read.store(m_write.load(std::memory_order_acquire), std::memory_order_release);
+}
+
+bool audio_ring::wait(size_t n, int timeout_ms) {
+    n = std::min(n, m_window);
+
+    const auto t_end = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    while (true) {
+        const uint32_t seq = m_event.prepare();
+
+        m_wake_at.store(m_read.load(std::memory_order_relaxed) + n, std::memory_order_seq_cst);
+        if (size() >= n) {
+            m_wake_at.store(UINT64_MAX, std::memory_order_relaxed);
+            return true;
+        }
+
+        const int remaining = (int) std::chrono::duration_cast<std::chrono::milliseconds>(t_end - std::chrono::steady_clock::now()).count();
+        if (remaining <= 0) {
+            m_wake_at.store(UINT64_MAX, std::memory_order_relaxed);
+            return false;
+        }
+
+        m_event.wait(seq, remaining);
+    }
+}
+
+size_t audio_ring::size() const {
+    const uint64_t w = m_write.load(std::memory_order_acquire);
+    const uint64_t r = m_read .load(std::memory_order_relaxed);
+
+    return std::min<uint64_t>(w - std::min(r, w), m_window);
+}
+
+// the capture buffer before the ring: one lock around every callback and every get()
+struct audio_ring_bench_locked {
+    std::mutex         mutex;
+    std::vector<float> audio;
+    size_t             pos = 0;
+    size_t             len = 0;
+
+    void write(const float * data, size_t n) {
+        std::lock_guard<std::mutex> lock(mutex);
+        const size_t n0 = std::min(n, audio.size() - pos);
+        memcpy(audio.data() + pos, data,      n0*sizeof(float));
+        memcpy(audio.data(),       data + n0, (n - n0)*sizeof(float));
+        pos = (pos + n) % audio.size();
+        len = std::min(len + n, audio.size());
+    }
+
+    void get(size_t n, std::vector<float> & result) {
+        std::lock_guard<std::mutex> lock(mutex);
+        n = std::min(n, len);
+        result.resize(n);
+        const size_t start = (pos + audio.size() - n) % audio.size();
+        const size_t n0    = std::min(n, audio.size() - start);
+        memcpy(result.data(),      audio.data() + start, n0*sizeof(float));
+        memcpy(result.data() + n0, audio.data(),         (n - n0)*sizeof(float));
+    }
+};
+
+void audio_ring_bench(int sample_rate) {
+    const size_t n_window    = (size_t) 10*sample_rate;
+    const size_t n_callback  = sample_rate/100;
+    const int    n_callbacks = 3000;
+
+    // callbacks come every millisecond, ten times faster than a device, to collect enough of them
+    const auto t_period = std::chrono::microseconds(1000);
+
+    printf("\n%s: %d callbacks of %zu samples, window of %zu samples, consumer idle or in get(window)\n\n",
+            __func__, n_callbacks, n_callback, n_window);
+    printf("%8s %10s %10s %10s %10s %10s %10s\n", "storage", "consumer", "gets", "torn", "p50 us", "p99 us", "max us");
+
+    std::vector<float> input(n_callback);
+    for (size_t i = 0; i < n_callback; ++i) {
+        input[i] = (float) i/n_callback;
+    }
+
+    for (int locked = 0; locked < 2; ++locked) {
+        for (int busy = 0; busy < 2; ++busy) {
+            audio_ring ring;
+            ring.init(n_window);
+
+            audio_ring_bench_locked buffer;
+            buffer.audio.assign(n_window, 0.0f);
+
+            std::atomic<bool> done(false);
+            uint64_t n_gets = 0;
+            uint64_t n_torn = 0;
+
+            std::thread consumer([&]() {
+                std::vector<float> result;
+                result.reserve(n_window);
+                while (busy && !done.load(std::memory_order_relaxed)) {
+                    if (locked) {
+                        buffer.get(n_window, result);
+                    } else {
+                        const size_t n_avail = std::min<uint64_t>(ring.n_written(), n_window);
+                        ring.get(n_window, result);
+                        n_torn += result.size() < n_avail ? 1 : 0;
+                    }
+                    n_gets++;
+                }
+            });
+
+            std::vector<double> t_us(n_callbacks);
+            auto t_next = std::chrono::steady_clock::now();
+            for (int i = 0; i < n_callbacks; ++i) {
+                t_next += t_period;
+                std::this_thread::sleep_until(t_next);
+
+                const auto t0 = std::chrono::steady_clock::now();
+                if (locked) {
+                    buffer.write(input.data(), n_callback);
+                } else {
+                    ring.write(input.data(), n_callback);
+                }
+                t_us[i] = 1e6*std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+            }
+
+            done.store(true);
+            consumer.join();
+
+            std::sort(t_us.begin(), t_us.end());
+            printf("%8s %10s %10llu %10llu %10.2f %10.2f %10.2f\n", locked ? "mutex" : "ring", busy ? "get()" : "idle",
+                    (unsigned long long) n_gets, (unsigned long long) n_torn,
+                    t_us[n_callbacks/2], t_us[n_callbacks*99/100], t_us.back());
+        }
+    }
+}
+
+void audio_ring_wait_bench(int sample_rate) {
+    const size_t n_callback = sample_rate/100;
+    const size_t n_step     = sample_rate/10;
+    const int    n_steps    = 30;
+
+    printf("\n%s: %d steps of %zu samples, a callback of %zu samples every 10 ms\n\n", __func__, n_steps, n_step, n_callback);
+    printf("%10s %10s %12s %10s %10s %10s %10s\n", "consumer", "wake-ups", "per step", "% core", "p50 ms", "p99 ms", "max ms");
+
+    const std::vector<float> input(n_callback, 0.0f);
+
+    for (int poll = 0; poll < 2; ++poll) {
+        audio_ring ring;
+        ring.init(4*n_step);
+
+        // when the write that completed each step was committed
+        const int n_callbacks = (int) (n_steps*n_step/n_callback);
+        std::vector<std::atomic<int64_t>> t_complete(n_steps);
+        for (auto & t : t_complete) {
+            t.store(0);
+        }
+        const auto t_base = std::chrono::steady_clock::now();
+
+        std::vector<double> t_handoff_ms;
+        t_handoff_ms.reserve(n_steps);
+        uint64_t n_wakeups = 0;
+        double   t_cpu     = 0.0;
+        double   t_wall    = 0.0;
+
+        std::thread consumer([&]() {
+            const double cpu0 = ring_thread_cpu_seconds();
+            const auto   t0   = std::chrono::steady_clock::now();
+
+            std::vector<float> step(n_step);
+            uint64_t cursor = 0;
+            for (int k = 0; k < n_steps; ++k) {
+                while (ring.size() < n_step) {
+                    n_wakeups++;
+                    if (poll) {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    } else {
+                        ring.wait(n_step, 1000);
+                    }
+                }
+                const int64_t t_now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t_base).count();
+
+                uint64_t pos = 0;
+                ring.read_since(cursor, step.data(), n_step, pos);
+                t_handoff_ms.push_back(1e-6*double(t_now - t_complete[k].load()));
+            }
+
+            t_cpu  = ring_thread_cpu_seconds() - cpu0;
+            t_wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        });
+
+        auto t_next = std::chrono::steady_clock::now();
+        uint64_t n_written = 0;
+        for (int i = 0; i < n_callbacks; ++i) {
+            t_next += std::chrono::milliseconds(10);
+            std::this_thread::sleep_until(t_next);
+
+            // stamped before the commit, so the consumer never reads a step that has no time yet
+            n_written += n_callback;
+            if (n_written % n_step == 0) {
+                t_complete[n_written/n_step - 1].store(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t_base).count());
+            }
+            ring.write(input.data(), n_callback);
+        }
+        consumer.join();
+
+        std::sort(t_handoff_ms.begin(), t_handoff_ms.end());
+        printf("%10s %10llu %12.1f %10.3f %10.3f %10.3f %10.3f\n", poll ? "poll 1 ms" : "wait()",
+                (unsigned long long) n_wakeups, double(n_wakeups)/n_steps, t_wall > 0 ? 100.0*t_cpu/t_wall : 0.0,
+                t_handoff_ms[n_steps/2], t_handoff_ms[n_steps*99/100], t_handoff_ms.back());
+    }
+
+    // the same handoff one stage later: a chunk queued every step for the inference thread,
+    // which sleeps in pop_wait() or polls pop() every millisecond
+    printf("\n%s: %d chunks through a bounded_queue, one every 100 ms\n\n", __func__, n_steps);
+    printf("%10s %10s %12s %10s %10s %10s %10s\n", "consumer", "wake-ups", "per chunk", "% core", "p50 ms", "p99 ms", "max ms");
+
+    for (int poll = 0; poll < 2; ++poll) {
+        // each item is the time it was pushed
+        bounded_queue<int64_t> queue(8, queue_overflow::drop_oldest);
+        const auto t_base = std::chrono::steady_clock::now();
+
+        std::vector<double> t_handoff_ms;
+        t_handoff_ms.reserve(n_steps);
+        uint64_t n_wakeups = 0;
+        double   t_cpu     = 0.0;
+        double   t_wall    = 0.0;
+
+        std::thread consumer([&]() {
+            const double cpu0 = ring_thread_cpu_seconds();
+            const auto   t0   = std::chrono::steady_clock::now();
+
+            int64_t t_push = 0;
+            for (int k = 0; k < n_steps; ++k) {
+                while (true) {
+                    n_wakeups++;
+                    if (poll) {
+                        if (queue.pop(t_push)) {
+                            break;
+                        }
+                        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    } else if (queue.pop_wait(t_push, 1000)) {
+                        break;
+                    }
+                }
+                const int64_t t_now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t_base).count();
+                t_handoff_ms.push_back(1e-6*double(t_now - t_push));
+            }
+
+            t_cpu  = ring_thread_cpu_seconds() - cpu0;
+            t_wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        });
+
+        auto t_next = std::chrono::steady_clock::now();
+        for (int k = 0; k < n_steps; ++k) {
+            t_next += std::chrono::milliseconds(100);
+            std::this_thread::sleep_until(t_next);
+
+            int64_t item = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t_base).count();
+            int64_t spill = 0;
+            queue.push(std::move(item), spill);
+        }
+        consumer.join();
+
+        std::sort(t_handoff_ms.begin(), t_handoff_ms.end());
+        printf("%10s %10llu %12.1f %10.3f %10.3f %10.3f %10.3f\n", poll ? "poll 1 ms" : "pop_wait()",
+                (unsigned long long) n_wakeups, double(n_wakeups)/n_steps, t_wall > 0 ? 100.0*t_cpu/t_wall : 0.0,
+                t_handoff_ms[n_steps/2], t_handoff_ms[n_steps*99/100], t_handoff_ms.back());
+    }
+}
@@ -0,0 +1,267 @@
+#include "batch.h"
+
+#include "chunker.h"
+#include "common-whisper.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <thread>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+// audio decoded ahead of the workers, bounds memory on large directories
+#define BATCH_MAX_PENDING_SEC (4*3600)
+
+// cuts are searched in the last BATCH_CUT_WINDOW_SEC of a chunk, on 10 ms frames
+#define BATCH_CUT_WINDOW_SEC 5
+#define BATCH_CUT_FRAME      160
+
+static bool is_audio_file(const std::string & name) {
+    static const char * exts[] = { ".wav", ".mp3", ".flac", ".ogg" };
+
+    const size_t dot = name.find_last_of('.');
+    if (dot == std::string::npos) {
+        return false;
+    }
+    std::string ext = name.substr(dot);
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return (char) tolower(c); });
+
+    for (const char * e : exts) {
+        if (ext == e) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// files of the directory in name order, empty if path is not a directory
+static std::vector<std::string> list_directory(const std::string & path) {
+    std::vector<std::string> res;
+
+#ifdef _WIN32
+    const DWORD attr = GetFileAttributesA(path.c_str());
+    if (attr == INVALID_FILE_ATTRIBUTES || !(attr & FILE_ATTRIBUTE_DIRECTORY)) {
+        return res;
+    }
+
+    WIN32_FIND_DATAA fd;
+    HANDLE h = FindFirstFileA((path + "\\*").c_str(), &fd);
+    if (h == INVALID_HANDLE_VALUE) {
+        return res;
+    }
+    do {
+        if (!(fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && is_audio_file(fd.cFileName)) {
+            res.push_back(path + "\\" + fd.cFileName);
+        }
+    } while (FindNextFileA(h, &fd));
+    FindClose(h);
+#else
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+        return res;
+    }
+
+    DIR * dir = opendir(path.c_str());
+    if (dir == nullptr) {
+        return res;
+    }
+    while (struct dirent * e = readdir(dir)) {
+        const std::string fname = path + "/" + e->d_name;
+        if (stat(fname.c_str(), &st) == 0 && S_ISREG(st.st_mode) && is_audio_file(e->d_name)) {
+            res.push_back(fname);
+        }
+    }
+    closedir(dir);
+#endif
+
+    std::sort(res.begin(), res.end());
+    return res;
+}
+
+// end of the chunk starting at x[0]: the quietest 10 ms frame in the last few seconds
+// before n_max, or n if the rest of the audio fits
+static size_t find_cut(const float * x, size_t n, size_t n_max) {
+    if (n <= n_max) {
+        return n;
+    }
+
+    const size_t n_window = std::min(n_max/2, (size_t) BATCH_CUT_WINDOW_SEC*WHISPER_SAMPLE_RATE);
+    const size_t i_quiet  = chunk_find_quiet(x, n_max - n_window, n_max, BATCH_CUT_FRAME);
+
+    // cut in the middle of the quiet frame
+    return i_quiet + BATCH_CUT_FRAME/2;
+}
+
+struct batch_file {
+    std::string        fname;
+    std::vector<float> pcmf32;
+};
+
+struct batch_chunk {
+    int    i_file;
+    size_t offset;
+    size_t n;
+
+    std::vector<std::string> lines;
+};
+
+// transcribe the chunks with one state per worker
+static bool batch_run(whisper_context * ctx, const whisper_full_params & wparams, std::vector<batch_file> & files, std::vector<batch_chunk> & chunks, int n_workers) {
+    std::atomic<size_t> next(0);
+    std::atomic<bool>   failed(false);
+
+    auto worker = [&]() {
+        whisper_state * state = whisper_init_state(ctx);
+        if (state == nullptr) {
+            failed.store(true);
+            return;
+        }
+
+        for (size_t i = next++; i < chunks.size() && !failed.load(); i = next++) {
+            batch_chunk & c = chunks[i];
+            const float * samples = files[c.i_file].pcmf32.data() + c.offset;
+
+            if (whisper_full_with_state(ctx, state, wparams, samples, (int) c.n) != 0) {
+                fprintf(stderr, "%s: failed to process '%s'\n", __func__, files[c.i_file].fname.c_str());
+                failed.store(true);
+                break;
+            }
+
+            // segment times are relative to the chunk, shift them onto the file timeline
+            const int64_t t_offset = (int64_t) (c.offset*100/WHISPER_SAMPLE_RATE);
+            const int n_segments = whisper_full_n_segments_from_state(state);
+            for (int j = 0; j < n_segments; ++j) {
+                const int64_t t0 = t_offset + whisper_full_get_segment_t0_from_state(state, j);
+                const int64_t t1 = t_offset + whisper_full_get_segment_t1_from_state(state, j);
+                c.lines.push_back("[" + to_timestamp(t0) + " --> " + to_timestamp(t1) + "]" + whisper_full_get_segment_text_from_state(state, j));
+            }
+        }
+
+        whisper_free_state(state);
+    };
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < n_workers; ++i) {
+        workers.emplace_back(worker);
+    }
+    for (auto & w : workers) {
+        w.join();
+    }
+
+    return !failed.load();
+}
+
+bool batch_transcribe(
+        whisper_context * ctx,
+        const whisper_full_params & wparams,
+        const std::vector<std::string> & inputs,
+        int n_workers,
+        int n_samples_max,
+        const std::string & fname_out) {
+    std::vector<std::string> fnames;
+    for (const auto & in : inputs) {
+        const std::vector<std::string> dir = list_directory(in);
+        if (!dir.empty()) {
+            fnames.insert(fnames.end(), dir.begin(), dir.end());
+        } else {
+            fnames.push_back(in);
+        }
+    }
+
+    std::ofstream fout;
+    if (!fname_out.empty()) {
+        fout.open(fname_out);
+        if (!fout.is_open()) {
+            fprintf(stderr, "%s: failed to open output file '%s'\n", __func__, fname_out.c_str());
+            return false;
+        }
+    }
+
+    n_workers = std::max(1, n_workers);
+
+    fprintf(stderr, "%s: %d files, %d workers x %d threads, chunks of at most %.1f sec\n",
+            __func__, (int) fnames.size(), n_workers, wparams.n_threads, float(n_samples_max)/WHISPER_SAMPLE_RATE);
+
+    const auto t_start = std::chrono::steady_clock::now();
+    double t_audio = 0.0;
+
+    // files are decoded in groups so a large directory never sits in memory at once
+    size_t i_next = 0;
+    while (i_next < fnames.size()) {
+        std::vector<batch_file>  files;
+        std::vector<batch_chunk> chunks;
+
+        size_t n_pending = 0;
+        while (i_next < fnames.size() && n_pending < (size_t) BATCH_MAX_PENDING_SEC*WHISPER_SAMPLE_RATE) {
+            batch_file f;
+            f.fname = fnames[i_next++];
+
+            std::vector<std::vector<float>> pcmf32s;
+            if (!read_audio_data(f.fname, f.pcmf32, pcmf32s, false)) {
+                fprintf(stderr, "%s: failed to read '%s', skipping\n", __func__, f.fname.c_str());
+                continue;
+            }
+
+            const int i_file = (int) files.size();
+            for (size_t off = 0; off < f.pcmf32.size(); ) {
+                const size_t n = find_cut(f.pcmf32.data() + off, f.pcmf32.size() - off, n_samples_max);
+                chunks.push_back({ i_file, off, n, {} });
+                off += n;
+            }
+
+            n_pending += f.pcmf32.size();
+            files.push_back(std::move(f));
+        }
+
+        // longest chunks first so the last worker does not finish long after the others
+        std::stable_sort(chunks.begin(), chunks.end(), [](const batch_chunk & a, const batch_chunk & b) { return a.n > b.n; });
+
+        if (!batch_run(ctx, wparams, files, chunks, n_workers)) {
+            return false;
+        }
+
+        // chunks of a file are unique by offset, restore the timeline order
+        std::stable_sort(chunks.begin(), chunks.end(), [](const batch_chunk & a, const batch_chunk & b) {
+            return a.i_file != b.i_file ? a.i_file < b.i_file : a.offset < b.offset;
+        });
+
+        int i_file = -1;
+        for (const auto & c : chunks) {
+            if (c.i_file != i_file) {
+                i_file = c.i_file;
+                printf("\n%s:\n", files[i_file].fname.c_str());
+                if (fout.is_open()) {
+                    fout << "\n" << files[i_file].fname << ":\n";
+                }
+            }
+            for (const auto & line : c.lines) {
+                printf("%s\n", line.c_str());
+                if (fout.is_open()) {
+                    fout << line << "\n";
+                }
+            }
+        }
+        fflush(stdout);
+
+        t_audio += double(n_pending)/WHISPER_SAMPLE_RATE;
+    }
+
+    const double t_wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+
+    fprintf(stderr, "\n%s: %.2f hours of audio in %.1f sec, throughput %.1f audio-hours per wall-hour\n",
+            __func__, t_audio/3600.0, t_wall, t_wall > 0 ? t_audio/t_wall : 0.0);
+
+    return true;
+}
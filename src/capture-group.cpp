@@ -0,0 +1,353 @@
+#include "capture-group.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <thread>
+
+capture_group::capture_group(const vad_stream_params & vparams, int step_ms, int chunk_ms, int chunk_tol_ms, int chunk_max_ms)
+    : m_vparams(vparams), m_step_ms(step_ms), m_chunk_ms(chunk_ms), m_chunk_tol_ms(chunk_tol_ms), m_chunk_max_ms(chunk_max_ms) {
+    // at least one VAD frame, an empty step would never read anything
+    m_n_step = std::max((size_t) ((int64_t) vparams.sample_rate*std::max(step_ms, 0)/1000), (size_t) vparams.sample_rate/100);
+}
+
+size_t capture_group::add(const std::string & label, std::unique_ptr<audio_capture> audio, std::unique_ptr<vad_backend> vad) {
+    source s;
+    s.label   = label;
+    s.audio   = std::move(audio);
+    s.vad     = std::unique_ptr<vad_stream>(new vad_stream(m_vparams, std::move(vad)));
+    s.chunker = std::unique_ptr<silence_chunker>(new silence_chunker(m_vparams.sample_rate, m_chunk_ms, m_chunk_tol_ms, m_chunk_max_ms));
+
+    m_sources.push_back(std::move(s));
+
+    m_speech.reserve(m_sources.back().vad->max_forward(m_n_step));
+
+    return m_sources.size() - 1;
+}
+
+void capture_group::set_echo_reference(size_t i_mic, size_t i_ref, echo_params params, float max_share) {
+    source & s = m_sources[i_mic];
+
+    // chunks are gated right after they are cut, their blocks must still be in the history
+    const int chunk_ms = m_chunk_max_ms + m_vparams.pre_roll_ms + m_vparams.hangover_ms + m_step_ms;
+    params.sample_rate = m_vparams.sample_rate;
+    params.history_ms  = std::max(params.history_ms, chunk_ms);
+
+    s.ref            = (int) i_ref;
+    m_sources[i_ref].ref_of = (int) i_mic;
+
+    source & r = m_sources[i_ref];
+    r.n_history = 4*m_n_step;
+    r.history.assign(2*r.n_history, 0.0f);
+    s.aec            = std::unique_ptr<echo_canceller>(new echo_canceller(params));
+    s.echo_max_share = max_share;
+
+    // the canceller can also write out the block it held back from the previous step
+    m_ref  .resize(m_n_step);
+    m_clean.resize(m_n_step + params.block);
+
+    fprintf(stderr, "%s: '%s' is cancelled against '%s', %d ms tail, chunks above %.2f echo share dropped\n",
+            __func__, s.label.c_str(), m_sources[i_ref].label.c_str(), params.tail_ms, max_share);
+}
+
+bool capture_group::start(session_manager & sessions) {
+    for (auto & s : m_sources) {
+        s.session = sessions.open();
+        if (s.session < 0) {
+            fprintf(stderr, "%s: failed to create a session for '%s'\n", __func__, s.label.c_str());
+            return false;
+        }
+    }
+
+    for (auto & s : m_sources) {
+        if (!s.audio->resume()) {
+            fprintf(stderr, "%s: failed to start '%s'\n", __func__, s.label.c_str());
+            return false;
+        }
+    }
+
+    // audio from before the start is skipped and marked read, a file replayed with backpressure
+    // would wait for it otherwise
+    for (auto & s : m_sources) {
+        s.audio->clear();
+    }
+
+    // the shared clock starts here, the counters are read back to back
+    for (auto & s : m_sources) {
+        s.base   = s.audio->n_captured();
+        s.cursor = s.base;
+    }
+    m_t_start = std::chrono::steady_clock::now();
+
+    return true;
+}
+
+bool capture_group::step(source & s, session_manager & sessions) {
+    // checked before reading, so the samples delivered last are part of this read
+    const bool eof = s.audio->eof();
+
+    const uint64_t n_pending = s.audio->n_captured() - s.cursor;
+    const bool     last      = eof && n_pending <= m_n_step;
+    if (n_pending < m_n_step && !last) {
+        return false;
+    }
+
+    // the reference is read up to the end of the step first, unless its device has stalled
+    if (s.aec) {
+        const source & r     = m_sources[s.ref];
+        const uint64_t r_end = r.base + (s.cursor - s.base) + m_n_step;
+        if (r.cursor < r_end && !r.done) {
+            const bool stalled = r.audio->n_captured() < r_end && (n_pending >= 2*m_n_step || last);
+            if (!stalled) {
+                return false;
+            }
+        }
+    }
+
+    // and the reference runs at most a step ahead of the microphone that still needs it
+    if (s.ref_of >= 0) {
+        const source & m = m_sources[s.ref_of];
+        if (!m.done && s.cursor - s.base >= m.cursor - m.base + m_n_step && m.audio->n_captured() - m.cursor >= m_n_step) {
+            return false;
+        }
+    }
+
+    const uint64_t expected = s.cursor;
+    const float *  data     = nullptr;
+    uint64_t       pos      = 0;
+    size_t         n        = s.audio->view_since(s.cursor, m_n_step, data, pos);
+
+    // samples overwritten before they were read leave a gap on the group clock
+    if (pos > expected) {
+        s.n_lost += pos - expected;
+        s.offset += (int64_t) (pos - expected);
+    }
+
+    if (s.ref_of >= 0) {
+        keep_reference(s, data, n, (int64_t) (pos - s.base));
+    }
+
+    // the canceller writes the step out, block aligned, so the VAD positions still match
+    const float * input = data;
+    if (s.aec) {
+        n     = s.aec->process(data, reference(s, pos, n), n, m_clean.data());
+        input = m_clean.data();
+    }
+
+    m_events.clear();
+    m_speech.clear();
+    s.vad->feed(input, n, m_events, m_speech);
+
+    // the VAD copied what it forwards, after this the step may be overwritten
+    // a torn step is dropped: the region so far goes out, one still open restarts after it
+    // the VAD clock already counts the step, so the offset stays
+    if (!s.audio->intact(pos)) {
+        s.n_torn++;
+        s.n_lost += n;
+        if (s.vad->in_speech()) {
+            s.chunker->begin(s.vad->position());
+        } else {
+            s.chunker->flush();
+        }
+    } else {
+        size_t i_speech = 0;
+        for (const auto & e : m_events) {
+            s.chunker->push(m_speech.data() + i_speech, e.i_speech - i_speech);
+            i_speech = e.i_speech;
+            if (e.type == vad_event::speech_start) {
+                s.chunker->begin(e.pos);
+            } else {
+                s.chunker->flush();
+            }
+        }
+        s.chunker->push(m_speech.data() + i_speech, m_speech.size() - i_speech);
+    }
+
+    if (last) {
+        s.chunker->flush();
+        s.done = true;
+    }
+
+    emit(s, sessions);
+
+    return true;
+}
+
+void capture_group::emit(source & s, session_manager & sessions) {
+    // VAD positions count the samples fed since start(), the offset adds the lost ones
+    // the chunks go out in blocks the sessions gave back, so nothing is allocated per chunk
+    while (s.chunker->ready()) {
+        int64_t   pos_chunk = 0;
+        pcm_block chunk     = sessions.acquire();
+        s.chunker->pop(chunk, pos_chunk);
+
+        if (s.aec && s.aec->echo_share(pos_chunk, chunk.size()) > s.echo_max_share) {
+            s.n_echo_chunks++;
+            s.n_echo_samples += chunk.size();
+            sessions.release(std::move(chunk));
+            continue;
+        }
+
+        sessions.push(s.session, std::move(chunk), pos_chunk + s.offset);
+        s.n_chunks++;
+    }
+}
+
+void capture_group::keep_reference(source & r, const float * data, size_t n, int64_t pos) {
+    const int64_t cap = (int64_t) r.n_history;
+
+    if (r.history_end == r.history_pos) {
+        r.history_pos = r.history_end = pos;
+    } else if (pos - r.history_end > cap) {
+        r.history_end = pos - cap;
+    }
+
+    // samples lost by the reference are silence
+    for (; r.history_end < pos + (int64_t) n; ++r.history_end) {
+        const size_t i = (size_t) (r.history_end % cap);
+        const float  v = r.history_end < pos ? 0.0f : data[r.history_end - pos];
+        r.history[i]               = v;
+        r.history[i + r.n_history] = v;
+    }
+
+    r.history_pos = std::max(r.history_pos, r.history_end - cap);
+}
+
+const float * capture_group::reference(source & s, uint64_t pos, size_t n) {
+    source & r = m_sources[s.ref];
+
+    // the reference before this step has been cancelled against already
+    const int64_t g0  = (int64_t) (pos - s.base);
+    const int64_t cap = (int64_t) r.n_history;
+    r.history_pos = std::max(r.history_pos, std::min(g0, r.history_end));
+
+    if (g0 >= r.history_pos && g0 + (int64_t) n <= r.history_end) {
+        return r.history.data() + g0 % cap;
+    }
+
+    // late or lost reference samples count as silence
+    std::fill(m_ref.begin(), m_ref.begin() + n, 0.0f);
+    const int64_t k0 = std::max(g0, r.history_pos);
+    const int64_t k1 = std::min(g0 + (int64_t) n, r.history_end);
+    if (k1 > k0) {
+        const float * src = r.history.data() + k0 % cap;
+        std::copy(src, src + (k1 - k0), m_ref.begin() + (k0 - g0));
+    }
+    s.n_ref_missing += n - (size_t) std::max<int64_t>(k1 - k0, 0);
+
+    return m_ref.data();
+}
+
+void capture_group::run(session_manager & sessions, const std::function<bool()> & keep_going) {
+    while (keep_going()) {
+        bool any      = false;
+        bool all_done = true;
+
+        // one step per source and pass, so a source with a backlog does not starve the others
+        for (auto & s : m_sources) {
+            if (!s.done) {
+                any = step(s, sessions) || any;
+            }
+            all_done = all_done && s.done;
+        }
+
+        if (all_done) {
+            break;
+        }
+        if (!any) {
+            // sleep on the source closest to a full step, sources that wait for another one
+            // are woken through it; the timeout bounds how late the others are looked at
+            source * next      = nullptr;
+            uint64_t n_pending = 0;
+            for (auto & s : m_sources) {
+                const uint64_t n = s.audio->n_captured() - s.cursor;
+                if (!s.done && n < m_n_step && (next == nullptr || n >= n_pending)) {
+                    next      = &s;
+                    n_pending = n;
+                }
+            }
+            const int step_ms = (int) (1000*m_n_step/m_vparams.sample_rate);
+            if (next) {
+                next->audio->wait(step_ms, step_ms);
+            } else {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+    }
+
+    m_t_run = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_t_start).count();
+    m_n_end.clear();
+    for (auto & s : m_sources) {
+        m_n_end.push_back(s.audio->n_captured());
+        s.audio->pause();
+
+        // an interrupted source still has its current region pending
+        if (!s.done) {
+            s.chunker->flush();
+            emit(s, sessions);
+        }
+    }
+
+    sessions.drain();
+}
+
+const std::string & capture_group::label(int id) const {
+    static const std::string unknown = "?";
+    for (const auto & s : m_sources) {
+        if (s.session == id) {
+            return s.label;
+        }
+    }
+    return unknown;
+}
+
+void capture_group::print_stats() const {
+    if (m_n_end.size() != m_sources.size()) {
+        return;
+    }
+
+    const double rate = m_vparams.sample_rate;
+
+    printf("\ncapture_group: %zu sources, %.1f sec\n\n", m_sources.size(), m_t_run);
+    printf("%-12s %10s %10s %8s %8s %10s %10s %10s\n", "source", "audio sec", "speech sec", "regions", "chunks", "lost", "overruns", "drift ppm");
+
+    const double n_ref = double(m_n_end[0] - m_sources[0].base);
+    for (size_t i = 0; i < m_sources.size(); ++i) {
+        const source & s = m_sources[i];
+        const double   n = double(m_n_end[i] - s.base);
+
+        // against the first source, only meaningful while both were capturing in real time
+        char drift[32] = "-";
+        if (i > 0 && n_ref > 0 && !s.audio->eof() && !m_sources[0].audio->eof()) {
+            snprintf(drift, sizeof(drift), "%.0f", 1e6*(n/n_ref - 1.0));
+        }
+
+        printf("%-12s %10.1f %10.1f %8llu %8llu %10llu %10llu %10s\n", s.label.c_str(), n/rate,
+                s.vad->n_forwarded()/rate, (unsigned long long) s.vad->n_regions(), (unsigned long long) s.n_chunks,
+                (unsigned long long) s.n_lost, (unsigned long long) s.audio->n_overruns(), drift);
+
+        if (s.aec) {
+            printf("%-12s echo: %llu chunks (%.1f sec) dropped, %.1f sec of reference missing\n", s.label.c_str(),
+                    (unsigned long long) s.n_echo_chunks, s.n_echo_samples/rate, s.n_ref_missing/rate);
+        }
+        if (s.n_torn > 0) {
+            printf("%-12s WARNING: %llu steps were overwritten while the VAD read them\n", s.label.c_str(), (unsigned long long) s.n_torn);
+        }
+    }
+}
+
+std::string capture_group_label(const std::string & name) {
+    if (name == "mic") {
+        return "local";
+    }
+    if (name == "system") {
+        return "remote";
+    }
+
+    const size_t i_dir = name.find_last_of("/\\");
+    std::string  base  = i_dir == std::string::npos ? name : name.substr(i_dir + 1);
+    const size_t i_ext = base.find_last_of('.');
+    if (i_ext != std::string::npos && i_ext > 0) {
+        base.resize(i_ext);
+    }
+    return base;
+}
@@ -0,0 +1,50 @@
+#include "catchup.h"
+
+#include <algorithm>
+#include <cstring>
+
+catchup_buffer::catchup_buffer(size_t n_window, size_t n_deadline)
+    : m_n_window(n_window), m_n_deadline(n_deadline) {
+    m_data.reserve(2*n_window);
+}
+
+void catchup_buffer::push(const float * data, size_t n) {
+    // compact once the consumed prefix dominates, so the buffer stays within its reserve
+    if (m_pos > 0 && m_pos >= size()) {
+        const size_t n_pending = size();
+        memmove(m_data.data(), m_data.data() + m_pos, n_pending*sizeof(float));
+        m_data.resize(n_pending);
+        m_pos = 0;
+    }
+
+    m_data.insert(m_data.end(), data, data + n);
+}
+
+void catchup_buffer::consume(size_t n) {
+    n = std::min(n, size());
+
+    m_pos    += n;
+    m_n_read += n;
+    m_n_windows++;
+
+    if (m_pos == m_data.size()) {
+        m_data.clear();
+        m_pos = 0;
+    }
+}
+
+bool catchup_buffer::behind(size_t n_lag) {
+    m_n_max_lag = std::max(m_n_max_lag, n_lag);
+
+    return m_n_deadline > 0 && n_lag > m_n_deadline;
+}
+
+size_t catchup_buffer::skip(size_t n_keep) {
+    const size_t n_drop = size() > n_keep ? size() - n_keep : 0;
+
+    m_pos       += n_drop;
+    m_n_read    += n_drop;
+    m_n_skipped += n_drop;
+
+    return n_drop;
+}
@@ -0,0 +1,109 @@
+#include "chunker.h"
+
+#include <algorithm>
+
+// a cut frame must be this much quieter than the average of its search window
+#define CHUNK_QUIET_RATIO 0.1
+
+size_t chunk_find_quiet(const float * x, size_t begin, size_t end, size_t n_frame, double * energy) {
+    size_t best   = begin;
+    double best_e = -1.0;
+    for (size_t i = begin; i + n_frame <= end; i += n_frame) {
+        double e = 0.0;
+        for (size_t j = 0; j < n_frame; ++j) {
+            e += x[i + j]*x[i + j];
+        }
+        if (best_e < 0.0 || e <= best_e) {
+            best_e = e;
+            best   = i;
+        }
+    }
+    if (energy) {
+        *energy = std::max(0.0, best_e);
+    }
+    return best;
+}
+
+silence_chunker::silence_chunker(int sample_rate, int target_ms, int tolerance_ms, int max_ms) {
+    m_n_frame     = sample_rate/100;
+    // at least one frame, a zero target would cut empty chunks forever
+    m_n_target    = std::max((size_t) std::max(target_ms, 0)*sample_rate/1000, m_n_frame);
+    m_n_tolerance = std::min((size_t) std::max(tolerance_ms, 0)*sample_rate/1000, m_n_target/2);
+    m_n_max       = std::max((size_t) std::max(max_ms, 0)*sample_rate/1000, m_n_target + m_n_tolerance);
+
+    m_pending.reserve(2*m_n_max);
+    m_done.reserve(2*m_n_max);
+}
+
+void silence_chunker::begin(int64_t pos) {
+    flush();
+    m_pos = pos;
+}
+
+void silence_chunker::push(const float * samples, size_t n) {
+    m_pending.insert(m_pending.end(), samples, samples + n);
+
+    while (m_pending.size() >= m_n_target + m_n_tolerance) {
+        if (m_n_tolerance == 0) {
+            cut(m_n_target);
+            continue;
+        }
+
+        const size_t i0 = m_n_target - m_n_tolerance;
+        const size_t i1 = m_n_target + m_n_tolerance;
+
+        double e_cut = 0.0;
+        const size_t i_cut = chunk_find_quiet(m_pending.data(), i0, i1, m_n_frame, &e_cut);
+
+        double e_sum = 0.0;
+        for (size_t i = i0; i < i1; ++i) {
+            e_sum += m_pending[i]*m_pending[i];
+        }
+        const double e_mean = e_sum*m_n_frame/(i1 - i0);
+
+        if (e_cut <= CHUNK_QUIET_RATIO*e_mean) {
+            cut(i_cut + m_n_frame/2);
+            continue;
+        }
+
+        // no pause near the target, wait for one up to the maximum length
+        if (m_pending.size() < m_n_max) {
+            break;
+        }
+
+        cut(chunk_find_quiet(m_pending.data(), i0, m_n_max, m_n_frame) + m_n_frame/2);
+        m_n_forced++;
+    }
+}
+
+void silence_chunker::flush() {
+    if (!m_pending.empty()) {
+        cut(m_pending.size());
+    }
+}
+
+void silence_chunker::cut(size_t n) {
+    n = std::min(n, m_pending.size());
+
+    m_done.insert(m_done.end(), m_pending.begin(), m_pending.begin() + n);
+    m_spans.push_back({ m_pos, n });
+    m_n_chunks++;
+
+    m_pending.erase(m_pending.begin(), m_pending.begin() + n);
+    m_pos += n;
+}
+
+bool silence_chunker::pop(pcm_block & out, int64_t & pos) {
+    if (m_spans.empty()) {
+        return false;
+    }
+
+    const size_t n = m_spans.front().second;
+    pos = m_spans.front().first;
+    out.assign(m_done.begin(), m_done.begin() + n);
+
+    m_done.erase(m_done.begin(), m_done.begin() + n);
+    m_spans.pop_front();
+
+    return true;
+}
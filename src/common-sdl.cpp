@@ -22,8 +22,6 @@ bool audio_async::init(int capture_id, int sample_rate) {
         return false;
     }
 
-    SDL_SetHintWithPriority(SDL_HINT_AUDIO_RESAMPLING_MODE, "medium", SDL_HINT_OVERRIDE);
-
     int nDevices = SDL_GetNumAudioDevices(SDL_TRUE);
     fprintf(stderr, "%s: found %d capture devices:\n", __func__, nDevices);
     for (int i = 0; i < nDevices; i++) {
@@ -36,9 +34,25 @@ bool audio_async::init(int capture_id, int sample_rate) {
     SDL_zero(capture_spec_requested);
     SDL_zero(capture_spec_obtained);
 
-    capture_spec_requested.freq     = sample_rate;
+    // ask for the device's own rate and layout, so SDL does not convert on the way;
+    // downmixing and resampling to sample_rate is done in the callback
+    capture_spec_requested.freq     = 48000;
     capture_spec_requested.format   = AUDIO_F32;
     capture_spec_requested.channels = 1;
+#if SDL_VERSION_ATLEAST(2, 24, 0)
+    {
+        SDL_AudioSpec native;
+        SDL_zero(native);
+        const int res = capture_id >= 0 && capture_id < nDevices ?
+            SDL_GetAudioDeviceSpec(capture_id, SDL_TRUE, &native) : SDL_GetDefaultAudioInfo(nullptr, &native, SDL_TRUE);
+        if (res == 0 && native.freq > 0) {
+            capture_spec_requested.freq     = native.freq;
+            capture_spec_requested.channels = native.channels;
+        }
+    }
+#endif
+
+    const int allowed_changes = SDL_AUDIO_ALLOW_FREQUENCY_CHANGE | SDL_AUDIO_ALLOW_CHANNELS_CHANGE;
     capture_spec_requested.samples  = 1024;
     capture_spec_requested.callback = [](void * userdata, uint8_t * stream, int len) {
         audio_async * audio = (audio_async *) userdata;
@@ -59,10 +73,10 @@ bool audio_async::init(int capture_id, int sample_rate) {
         }
 
         fprintf(stderr, "%s: attempt to open capture device %d : '%s' ...\n", __func__, capture_id, device_name);
-        m_dev_id_in = SDL_OpenAudioDevice(device_name, SDL_TRUE, &capture_spec_requested, &capture_spec_obtained, 0);
+        m_dev_id_in = SDL_OpenAudioDevice(device_name, SDL_TRUE, &capture_spec_requested, &capture_spec_obtained, allowed_changes);
     } else {
         fprintf(stderr, "%s: attempt to open default capture device ...\n", __func__);
-        m_dev_id_in = SDL_OpenAudioDevice(nullptr, SDL_TRUE, &capture_spec_requested, &capture_spec_obtained, 0);
+        m_dev_id_in = SDL_OpenAudioDevice(nullptr, SDL_TRUE, &capture_spec_requested, &capture_spec_obtained, allowed_changes);
     }
 
     if (!m_dev_id_in) {
@@ -75,14 +89,17 @@ bool audio_async::init(int capture_id, int sample_rate) {
         fprintf(stderr, "%s:     - sample rate:       %d\n",                   __func__, capture_spec_obtained.freq);
         fprintf(stderr, "%s:     - format:            %d (required: %d)\n",    __func__, capture_spec_obtained.format,
                 capture_spec_requested.format);
-        fprintf(stderr, "%s:     - channels:          %d (required: %d)\n",    __func__, capture_spec_obtained.channels,
-                capture_spec_requested.channels);
+        fprintf(stderr, "%s:     - channels:          %d\n",                   __func__, capture_spec_obtained.channels);
         fprintf(stderr, "%s:     - samples per frame: %d\n",                   __func__, capture_spec_obtained.samples);
     }
 
-    m_sample_rate = capture_spec_obtained.freq;
+    m_sample_rate = sample_rate;
+    m_convert.init(capture_spec_obtained.freq, capture_spec_obtained.channels, sample_rate);
+    if (capture_spec_obtained.freq != sample_rate) {
+        fprintf(stderr, "%s:     - resampled to:      %d\n",                   __func__, sample_rate);
+    }
 
-    m_audio.resize((m_sample_rate*m_len_ms)/1000);
+    m_ring.init((m_sample_rate*m_len_ms)/1000);
 
     return true;
 }
@@ -134,46 +151,19 @@ bool audio_async::clear() {
         return false;
     }
 
-    {
-        std::lock_guard<std::mutex> lock(m_mutex);
-
-        m_audio_pos = 0;
-        m_audio_len = 0;
-    }
+    m_ring.clear();
 
     return true;
 }
 
 // callback to be called by SDL
+// runs on the SDL audio thread - must not block, so the samples go straight into the lock-free ring
 void audio_async::callback(uint8_t * stream, int len) {
     if (!m_running) {
         return;
     }
 
-    size_t n_samples = len / sizeof(float);
-
-    if (n_samples > m_audio.size()) {
-        n_samples = m_audio.size();
-
-        stream += (len - (n_samples * sizeof(float)));
-    }
-
-    //fprintf(stderr, "%s: %zu samples, pos %zu, len %zu\n", __func__, n_samples, m_audio_pos, m_audio_len);
-
-    {
-        std::lock_guard<std::mutex> lock(m_mutex);
-
-        if (m_audio_pos + n_samples > m_audio.size()) {
-            const size_t n0 = m_audio.size() - m_audio_pos;
-
-            memcpy(&m_audio[m_audio_pos], stream, n0 * sizeof(float));
-            memcpy(&m_audio[0], stream + n0 * sizeof(float), (n_samples - n0) * sizeof(float));
-        } else {
-            memcpy(&m_audio[m_audio_pos], stream, n_samples * sizeof(float));
-        }
-        m_audio_pos = (m_audio_pos + n_samples) % m_audio.size();
-        m_audio_len = std::min(m_audio_len + n_samples, m_audio.size());
-    }
+    m_convert.process((const float *) stream, len / (sizeof(float) * m_convert.n_channels()), m_ring);
 }
 
 void audio_async::get(int ms, std::vector<float> & result) {
@@ -187,36 +177,23 @@ void audio_async::get(int ms, std::vector<float> & result) {
         return;
     }
 
-    result.clear();
-
-    {
-        std::lock_guard<std::mutex> lock(m_mutex);
-
-        if (ms <= 0) {
-            ms = m_len_ms;
-        }
-
-        size_t n_samples = (m_sample_rate * ms) / 1000;
-        if (n_samples > m_audio_len) {
-            n_samples = m_audio_len;
-        }
-
-        result.resize(n_samples);
+    if (ms <= 0) {
+        ms = m_len_ms;
+    }
 
-        int s0 = m_audio_pos - n_samples;
-        if (s0 < 0) {
-            s0 += m_audio.size();
-        }
+    m_ring.get((m_sample_rate * ms) / 1000, result);
+}
 
-        if (s0 + n_samples > m_audio.size()) {
-            const size_t n0 = m_audio.size() - s0;
+bool audio_async::wait(int ms, int timeout_ms) {
+    if (!m_dev_id_in || !m_running) {
+        return false;
+    }
 
-            memcpy(result.data(), &m_audio[s0], n0 * sizeof(float));
-            memcpy(&result[n0], &m_audio[0], (n_samples - n0) * sizeof(float));
-        } else {
-            memcpy(result.data(), &m_audio[s0], n_samples * sizeof(float));
-        }
+    if (ms <= 0) {
+        ms = m_len_ms;
     }
+
+    return m_ring.wait((m_sample_rate * ms) / 1000, timeout_ms);
 }
 
 bool sdl_poll_events() {
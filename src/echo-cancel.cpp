@@ -0,0 +1,289 @@
+#define _USE_MATH_DEFINES // for M_PI
+#include "echo-cancel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+
+// smoothing of the per-bin error power, about 10 blocks
+#define ECHO_POWER_DECAY 0.9f
+
+// bins with less reference power than this (white noise around -70 dBFS) are not adapted
+#define ECHO_POWER_FLOOR 1e-7f
+
+echo_canceller::echo_canceller(const echo_params & params)
+    : m_n(params.block),
+      m_n_part(std::max(1, (params.tail_ms*params.sample_rate/1000 + params.block - 1)/params.block)),
+      m_mu(params.mu),
+      m_fft(2*params.block) {
+    const size_t n_bins = m_n + 1;
+
+    m_x.resize(2*m_n);
+    m_X.resize(m_n_part*n_bins);
+    m_W.resize(m_n_part*n_bins);
+
+    m_px.resize(n_bins);
+    m_pe.resize(n_bins);
+
+    m_Y.resize(n_bins);
+    m_E.resize(n_bins);
+    m_y.resize(2*m_n);
+    m_e.resize(2*m_n);
+
+    m_mic_hold.resize(m_n);
+    m_ref_hold.resize(m_n);
+
+    m_stats.resize(std::max<size_t>(1, (size_t) params.history_ms*params.sample_rate/1000/m_n));
+
+    reset();
+}
+
+void echo_canceller::reset() {
+    std::fill(m_x.begin(), m_x.end(), 0.0f);
+    std::fill(m_X.begin(), m_X.end(), std::complex<float>(0.0f));
+    std::fill(m_W.begin(), m_W.end(), std::complex<float>(0.0f));
+    std::fill(m_px.begin(), m_px.end(), 0.0f);
+    std::fill(m_pe.begin(), m_pe.end(), 0.0f);
+
+    m_i_x         = 0;
+    m_i_constrain = 0;
+    m_n_hold      = 0;
+    m_n_blocks    = 0;
+}
+
+size_t echo_canceller::process(const float * mic, const float * ref, size_t n, float * out) {
+    size_t n_out = 0;
+
+    // complete the held block first
+    if (m_n_hold > 0) {
+        const size_t k = std::min(n, (size_t) m_n - m_n_hold);
+        std::copy(mic, mic + k, m_mic_hold.begin() + m_n_hold);
+        std::copy(ref, ref + k, m_ref_hold.begin() + m_n_hold);
+        m_n_hold += k;
+        mic += k;
+        ref += k;
+        n   -= k;
+
+        if (m_n_hold < (size_t) m_n) {
+            return 0;
+        }
+        block(m_mic_hold.data(), m_ref_hold.data(), out);
+        n_out    = m_n;
+        m_n_hold = 0;
+    }
+
+    while (n >= (size_t) m_n) {
+        block(mic, ref, out + n_out);
+        n_out += m_n;
+        mic   += m_n;
+        ref   += m_n;
+        n     -= m_n;
+    }
+
+    std::copy(mic, mic + n, m_mic_hold.begin());
+    std::copy(ref, ref + n, m_ref_hold.begin());
+    m_n_hold = n;
+
+    return n_out;
+}
+
+void echo_canceller::block(const float * mic, const float * ref, float * out) {
+    const int n      = m_n;
+    const int n_bins = n + 1;
+
+    // spectrum of the reference over the previous and the current block
+    std::copy(m_x.begin() + n, m_x.end(), m_x.begin());
+    std::copy(ref, ref + n, m_x.begin() + n);
+
+    m_i_x = (m_i_x + m_n_part - 1) % m_n_part;
+    std::complex<float> * X0 = m_X.data() + (size_t) m_i_x*n_bins;
+    m_fft.forward(m_x.data(), X0);
+
+    // echo estimate, the second half of the circular convolution is the linear one
+    // the reference power over the whole span of the filter is summed on the way
+    std::fill(m_Y.begin(), m_Y.end(), std::complex<float>(0.0f));
+    std::fill(m_px.begin(), m_px.end(), 0.0f);
+    for (int p = 0; p < m_n_part; ++p) {
+        const std::complex<float> * X = m_X.data() + (size_t) ((m_i_x + p) % m_n_part)*n_bins;
+        const std::complex<float> * W = m_W.data() + (size_t) p*n_bins;
+        for (int k = 0; k < n_bins; ++k) {
+            m_Y[k]  += W[k]*X[k];
+            m_px[k] += std::norm(X[k]);
+        }
+    }
+    m_fft.inverse(m_Y.data(), m_y.data());
+
+    block_stats st = { 0.0f, 0.0f, 0.0f };
+
+    std::fill(m_e.begin(), m_e.begin() + n, 0.0f);
+    for (int i = 0; i < n; ++i) {
+        const float y = m_y[n + i];
+        const float e = mic[i] - y;
+
+        st.dd += mic[i]*mic[i];
+        st.dy += mic[i]*y;
+        st.yy += y*y;
+
+        m_e[n + i] = e;
+        out[i]     = e;
+    }
+
+    m_stats[m_n_blocks % m_stats.size()] = st;
+    m_n_blocks++;
+
+    // NLMS update of every partition with the error spectrum
+    m_fft.forward(m_e.data(), m_E.data());
+
+    const float floor = ECHO_POWER_FLOOR*2*n*m_n_part;
+    for (int k = 0; k < n_bins; ++k) {
+        m_pe[k] = ECHO_POWER_DECAY*m_pe[k] + (1.0f - ECHO_POWER_DECAY)*std::norm(m_E[k]);
+
+        // a quiet reference has nothing to adapt to, and double talk inflates the error
+        const float g = m_px[k] > floor ? m_mu/(m_px[k] + m_pe[k]) : 0.0f;
+        m_E[k] *= g;
+    }
+
+    for (int p = 0; p < m_n_part; ++p) {
+        const std::complex<float> * X = m_X.data() + (size_t) ((m_i_x + p) % m_n_part)*n_bins;
+        std::complex<float>       * W = m_W.data() + (size_t) p*n_bins;
+        for (int k = 0; k < n_bins; ++k) {
+            W[k] += std::conj(X[k])*m_E[k];
+        }
+    }
+
+    // the unconstrained update lets each partition grow a circular tail, cut one per block
+    std::complex<float> * W = m_W.data() + (size_t) m_i_constrain*n_bins;
+    m_fft.inverse(W, m_y.data());
+    std::fill(m_y.begin() + n, m_y.end(), 0.0f);
+    m_fft.forward(m_y.data(), W);
+    m_i_constrain = (m_i_constrain + 1) % m_n_part;
+}
+
+float echo_canceller::echo_share(int64_t pos, size_t n) const {
+    if (n == 0 || m_n_blocks == 0) {
+        return 0.0f;
+    }
+
+    // blocks that overlap the range and are still in the history
+    const uint64_t b_end   = std::min<uint64_t>(m_n_blocks, (uint64_t) ((pos + (int64_t) n + m_n - 1)/m_n));
+    const uint64_t b_first = m_n_blocks > m_stats.size() ? m_n_blocks - m_stats.size() : 0;
+    const uint64_t b_begin = std::max<uint64_t>(b_first, (uint64_t) std::max<int64_t>(0, pos/m_n));
+
+    // per block, dy^2/yy is the mic energy along the echo estimate
+    double e_mic  = 0.0;
+    double e_echo = 0.0;
+    for (uint64_t b = b_begin; b < b_end; ++b) {
+        const block_stats & st = m_stats[b % m_stats.size()];
+        e_mic += st.dd;
+        if (st.yy > 0.0f) {
+            e_echo += double(st.dy)*st.dy/st.yy;
+        }
+    }
+
+    return e_mic > 0.0 ? (float) std::min(1.0, e_echo/e_mic) : 0.0f;
+}
+
+// band-limited noise with a syllable-rate envelope and pauses, a stand-in for speech
+static std::vector<float> echo_bench_talker(size_t n, int sample_rate, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> noise(0.0f, 1.0f);
+
+    std::vector<float> x(n);
+    float lp = 0.0f;
+    for (size_t i = 0; i < n; ++i) {
+        const double t   = double(i)/sample_rate;
+        const double env = std::max(0.0, sin(2.0*M_PI*3.1*t + seed))*(sin(2.0*M_PI*0.23*t + seed) > -0.3 ? 1.0 : 0.0);
+
+        lp   = 0.85f*lp + 0.15f*noise(rng);
+        x[i] = (float) (0.5*env)*lp;
+    }
+    return x;
+}
+
+void echo_canceller_bench(int sample_rate) {
+    const double t_audio = 20.0;
+    const size_t n       = (size_t) (t_audio*sample_rate);
+    const size_t n_step  = sample_rate/100; // 10 ms, not a multiple of the block
+
+    const int tails_ms[] = { 128, 256, 512 };
+
+    // far end as heard through the speakers: 40 ms offset, then a 60 ms decaying room response
+    std::vector<float> ref = echo_bench_talker(n, sample_rate, 1);
+    std::vector<float> h((size_t) (0.1*sample_rate), 0.0f);
+    {
+        std::mt19937 rng(7);
+        std::normal_distribution<float> noise(0.0f, 1.0f);
+        const size_t i0 = (size_t) (0.04*sample_rate);
+        double e = 0.0;
+        for (size_t i = i0; i < h.size(); ++i) {
+            h[i] = noise(rng)*expf(-(float) (i - i0)/(0.012f*sample_rate));
+            e   += h[i]*h[i];
+        }
+        for (auto & v : h) {
+            v *= (float) (0.5/sqrt(e)); // echo about 6 dB below the far end
+        }
+    }
+
+    std::vector<float> echo(n, 0.0f);
+    for (size_t i = 0; i < n; ++i) {
+        float sum = 0.0f;
+        for (size_t j = 0; j < h.size() && j <= i; ++j) {
+            sum += h[j]*ref[i - j];
+        }
+        echo[i] = sum;
+    }
+
+    // the local talker only speaks in the last quarter: double talk
+    std::vector<float> local = echo_bench_talker(n, sample_rate, 2);
+    const size_t i_talk = 3*n/4;
+    for (size_t i = 0; i < i_talk; ++i) {
+        local[i] = 0.0f;
+    }
+
+    // plus the noise floor of the microphone, around -60 dBFS
+    std::vector<float> mic(n);
+    {
+        std::mt19937 rng(3);
+        std::normal_distribution<float> noise(0.0f, 1e-3f);
+        for (size_t i = 0; i < n; ++i) {
+            mic[i] = echo[i] + local[i] + noise(rng);
+        }
+    }
+
+    printf("\n%s: %.0f sec at %d Hz, 40 ms device offset, fed in 10 ms steps\n\n", __func__, t_audio, sample_rate);
+    printf("%8s %8s %10s %14s %16s %10s\n", "tail ms", "parts", "ERLE dB", "share (echo)", "share (double)", "% core");
+
+    std::vector<float> out(n + n_step);
+    for (int tail_ms : tails_ms) {
+        echo_params params;
+        params.sample_rate = sample_rate;
+        params.tail_ms     = tail_ms;
+
+        echo_canceller aec(params);
+
+        const auto t_start = std::chrono::steady_clock::now();
+        size_t n_out = 0;
+        for (size_t off = 0; off < n; off += n_step) {
+            const size_t k = std::min(n_step, n - off);
+            n_out += aec.process(mic.data() + off, ref.data() + off, k, out.data() + n_out);
+        }
+        const double t_cpu = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+
+        // after convergence, echo only: second quarter to the start of the double talk
+        double e_mic = 0.0;
+        double e_res = 0.0;
+        for (size_t i = n/2; i < std::min(i_talk, n_out); ++i) {
+            e_mic += double(mic[i])*mic[i];
+            e_res += double(out[i])*out[i];
+        }
+
+        const float share_echo   = aec.echo_share((int64_t) n/2, i_talk - n/2);
+        const float share_double = aec.echo_share((int64_t) i_talk, n_out - i_talk);
+
+        printf("%8d %8d %10.1f %14.2f %16.2f %10.3f\n", tail_ms, aec.n_partitions(),
+                10.0*log10(e_mic/std::max(e_res, 1e-30)), share_echo, share_double, 100.0*t_cpu/t_audio);
+    }
+}
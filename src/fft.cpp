@@ -0,0 +1,178 @@
+#define _USE_MATH_DEFINES // for M_PI
+
+#include "fft.h"
+
+#include <cassert>
+#include <cmath>
+
+// largest radix handled by the generic butterfly
+#define FFT_MAX_RADIX 64
+
+fft_plan::fft_plan(int n) : m_n(n) {
+    m_twiddles.resize(n);
+    for (int k = 0; k < n; ++k) {
+        const double phase = -2.0*M_PI*k/n;
+        m_twiddles[k] = std::complex<float>((float) cos(phase), (float) sin(phase));
+    }
+
+    // factor out 4s first, then 2s, then odd primes
+    int p = 4;
+    int r = n;
+    while (r > 1) {
+        while (r % p != 0) {
+            switch (p) {
+                case 4:  p = 2; break;
+                case 2:  p = 3; break;
+                default: p += 2; break;
+            }
+            if (p*p > r) {
+                p = r;
+            }
+        }
+        r /= p;
+        m_factors.push_back(p);
+        m_factors.push_back(r);
+
+        assert(p <= FFT_MAX_RADIX && "fft_plan: prime factor too large");
+    }
+}
+
+void fft_plan::forward(const std::complex<float> * in, std::complex<float> * out) {
+    work(out, in, 1, m_factors.data());
+}
+
+// recursive decimation in time, one butterfly stage per factor
+void fft_plan::work(std::complex<float> * out, const std::complex<float> * in, int fstride, const int * factors) const {
+    const int p = factors[0];
+    const int m = factors[1];
+
+    std::complex<float> * out_end = out + p*m;
+
+    if (m == 1) {
+        for (std::complex<float> * o = out; o != out_end; ++o, in += fstride) {
+            *o = *in;
+        }
+    } else {
+        for (std::complex<float> * o = out; o != out_end; o += m, in += fstride) {
+            work(o, in, fstride*p, factors + 2);
+        }
+    }
+
+    const std::complex<float> * tw = m_twiddles.data();
+
+    switch (p) {
+        case 2:
+            {
+                for (int k = 0; k < m; ++k) {
+                    const std::complex<float> t = out[k + m]*tw[k*fstride];
+                    out[k + m] = out[k] - t;
+                    out[k]    += t;
+                }
+            } break;
+        case 4:
+            {
+                for (int k = 0; k < m; ++k) {
+                    const std::complex<float> s0 = out[k +   m]*tw[k*fstride];
+                    const std::complex<float> s1 = out[k + 2*m]*tw[k*fstride*2];
+                    const std::complex<float> s2 = out[k + 3*m]*tw[k*fstride*3];
+
+                    const std::complex<float> s5 = out[k] - s1;
+                    const std::complex<float> s6 = out[k] + s1;
+                    const std::complex<float> s3 = s0 + s2;
+                    const std::complex<float> s4 = s0 - s2;
+
+                    out[k + 2*m] = s6 - s3;
+                    out[k]       = s6 + s3;
+                    out[k +   m] = std::complex<float>(s5.real() + s4.imag(), s5.imag() - s4.real());
+                    out[k + 3*m] = std::complex<float>(s5.real() - s4.imag(), s5.imag() + s4.real());
+                }
+            } break;
+        default:
+            {
+                std::complex<float> scratch[FFT_MAX_RADIX];
+
+                for (int u = 0; u < m; ++u) {
+                    for (int q = 0, k = u; q < p; ++q, k += m) {
+                        scratch[q] = out[k];
+                    }
+                    for (int q1 = 0, k = u; q1 < p; ++q1, k += m) {
+                        int twidx = 0;
+                        out[k] = scratch[0];
+                        for (int q = 1; q < p; ++q) {
+                            twidx += fstride*k;
+                            if (twidx >= m_n) {
+                                twidx -= m_n;
+                            }
+                            out[k] += scratch[q]*tw[twidx];
+                        }
+                    }
+                }
+            } break;
+    }
+}
+
+fft_real::fft_real(int n) : m_n(n), m_half(n/2) {
+    m_twiddles.resize(n/2 + 1);
+    for (int k = 0; k <= n/2; ++k) {
+        const double phase = -2.0*M_PI*k/n;
+        m_twiddles[k] = std::complex<float>((float) cos(phase), (float) sin(phase));
+    }
+
+    m_packed  .resize(n/2);
+    m_spectrum.resize(n/2);
+    m_bins    .resize(n/2 + 1);
+}
+
+void fft_real::forward(const float * in, std::complex<float> * out) {
+    const int h = m_n/2;
+
+    // pack even/odd samples into the real/imaginary parts of a half-size transform
+    for (int i = 0; i < h; ++i) {
+        m_packed[i] = std::complex<float>(in[2*i], in[2*i + 1]);
+    }
+
+    m_half.forward(m_packed.data(), m_spectrum.data());
+
+    // split the half-size spectrum back into the spectrum of the real sequence
+    for (int k = 0; k <= h; ++k) {
+        const std::complex<float> z0 = m_spectrum[k % h];
+        const std::complex<float> z1 = std::conj(m_spectrum[(h - k) % h]);
+
+        const std::complex<float> even = 0.5f*(z0 + z1);
+        const std::complex<float> odd  = std::complex<float>(0.0f, -0.5f)*(z0 - z1);
+
+        out[k] = even + m_twiddles[k]*odd;
+    }
+}
+
+void fft_real::power(const float * in, float * out) {
+    forward(in, m_bins.data());
+
+    for (int k = 0; k <= m_n/2; ++k) {
+        out[k] = std::norm(m_bins[k]);
+    }
+}
+
+void fft_real::inverse(const std::complex<float> * in, float * out) {
+    const int h = m_n/2;
+
+    // merge the spectrum back into the half-size transform of the packed even/odd samples,
+    // conjugated, so the forward plan computes the inverse
+    for (int k = 0; k < h; ++k) {
+        const std::complex<float> x0 = in[k];
+        const std::complex<float> x1 = std::conj(in[h - k]);
+
+        const std::complex<float> even = 0.5f*(x0 + x1);
+        const std::complex<float> odd  = 0.5f*(x0 - x1)*std::conj(m_twiddles[k]);
+
+        m_spectrum[k] = std::conj(even + std::complex<float>(0.0f, 1.0f)*odd);
+    }
+
+    m_half.forward(m_spectrum.data(), m_packed.data());
+
+    const float scale = 1.0f/h;
+    for (int i = 0; i < h; ++i) {
+        out[2*i]     =  scale*m_packed[i].real();
+        out[2*i + 1] = -scale*m_packed[i].imag();
+    }
+}
@@ -0,0 +1,169 @@
+#include "file-audio.h"
+
+#include "common-whisper.h"
+#include "whisper.h"
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+file_audio_capture::file_audio_capture(int len_ms, const std::string & fname, float speed, int jitter_ms)
+    : m_fname(fname), m_speed(speed), m_jitter_ms(jitter_ms), m_len_ms(len_ms) {
+    m_running = false;
+    m_eof     = false;
+}
+
+file_audio_capture::~file_audio_capture() {
+    if (m_running) {
+        pause();
+    }
+    if (m_pipe && m_pipe != stdin) {
+        fclose(m_pipe);
+    }
+}
+
+static bool is_raw_pcm(const std::string & fname) {
+    const size_t i_ext = fname.find_last_of('.');
+    if (i_ext == std::string::npos) {
+        return false;
+    }
+    const std::string ext = fname.substr(i_ext);
+    return ext == ".raw" || ext == ".pcm";
+}
+
+bool file_audio_capture::init(int /*capture_id*/, int sample_rate) {
+    m_sample_rate = sample_rate;
+
+    if (m_fname == "-" || is_raw_pcm(m_fname)) {
+        m_pipe = m_fname == "-" ? stdin : fopen(m_fname.c_str(), "rb");
+        if (!m_pipe) {
+            fprintf(stderr, "%s: failed to open '%s'\n", __func__, m_fname.c_str());
+            return false;
+        }
+        m_convert.init(sample_rate, 1, sample_rate);
+        fprintf(stderr, "%s: reading raw 16-bit PCM at %d Hz from '%s'\n", __func__, sample_rate, m_fname.c_str());
+    } else {
+        std::vector<std::vector<float>> pcmf32s;
+        if (!read_audio_data(m_fname, m_pcm, pcmf32s, false)) {
+            fprintf(stderr, "%s: failed to read '%s'\n", __func__, m_fname.c_str());
+            return false;
+        }
+        m_convert.init(WHISPER_SAMPLE_RATE, 1, sample_rate);
+        fprintf(stderr, "%s: '%s', %.1f sec of audio\n", __func__, m_fname.c_str(), float(m_pcm.size())/WHISPER_SAMPLE_RATE);
+    }
+
+    if (m_speed > 0.0f) {
+        fprintf(stderr, "%s: replaying at %.1fx real time, jitter up to %d ms\n", __func__, m_speed, m_jitter_ms);
+    } else {
+        fprintf(stderr, "%s: replaying as fast as the pipeline reads\n", __func__);
+    }
+
+    m_ring.init((m_sample_rate*m_len_ms)/1000);
+
+    return true;
+}
+
+bool file_audio_capture::resume() {
+    if (m_running) {
+        fprintf(stderr, "%s: already running!\n", __func__);
+        return false;
+    }
+
+    m_running = true;
+    m_thread  = std::thread(&file_audio_capture::run, this);
+
+    return true;
+}
+
+bool file_audio_capture::pause() {
+    if (!m_running) {
+        fprintf(stderr, "%s: already paused!\n", __func__);
+        return false;
+    }
+
+    m_running = false;
+    m_thread.join();
+
+    return true;
+}
+
+bool file_audio_capture::clear() {
+    m_ring.clear();
+    return true;
+}
+
+void file_audio_capture::get(int ms, std::vector<float> & result) {
+    if (ms <= 0) {
+        ms = m_len_ms;
+    }
+
+    m_ring.get((m_sample_rate*ms)/1000, result);
+}
+
+bool file_audio_capture::wait(int ms, int timeout_ms) {
+    if (ms <= 0) {
+        ms = m_len_ms;
+    }
+
+    return m_ring.wait((m_sample_rate*ms)/1000, timeout_ms);
+}
+
+size_t file_audio_capture::read(float * dst, size_t n) {
+    if (!m_pipe) {
+        n = std::min(n, m_pcm.size() - m_pos);
+        std::copy(m_pcm.begin() + m_pos, m_pcm.begin() + m_pos + n, dst);
+        m_pos += n;
+        return n;
+    }
+
+    m_raw.resize(n);
+    n = fread(m_raw.data(), sizeof(int16_t), n, m_pipe);
+    for (size_t i = 0; i < n; ++i) {
+        dst[i] = float(m_raw[i])/32768.0f;
+    }
+    return n;
+}
+
+void file_audio_capture::run() {
+    using clock = std::chrono::steady_clock;
+
+    const size_t n_period = (size_t) m_convert.rate_in()/100;
+    const size_t n_out    = (size_t) m_sample_rate/100 + 1;
+
+    std::vector<float> block(n_period);
+
+    std::mt19937 rng(1234); // the same jitter on every run
+    std::uniform_int_distribution<int> jitter_us(0, 1000*std::max(m_jitter_ms, 0));
+
+    const auto t_start = clock::now();
+    auto       t_prev  = t_start;
+    uint64_t   n_periods = 0;
+
+    while (m_running) {
+        const size_t n = read(block.data(), n_period);
+        if (n == 0) {
+            m_eof.store(true, std::memory_order_release);
+            break;
+        }
+        n_periods++;
+
+        if (m_speed > 0.0f) {
+            // a period is due once it has been "recorded", a late one delays those behind it
+            auto t_due = t_start + std::chrono::microseconds((int64_t) (1e4*n_periods/m_speed));
+            if (m_jitter_ms > 0) {
+                t_due += std::chrono::microseconds(jitter_us(rng));
+            }
+            t_due  = std::max(t_due, t_prev);
+            t_prev = t_due;
+
+            std::this_thread::sleep_until(t_due);
+        } else {
+            // as fast as possible, but never overwrite what the consumer has not read yet
+            while (m_running && m_ring.size() + n_out > m_ring.window()) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+
+        m_convert.process(block.data(), n, m_ring);
+    }
+}
@@ -0,0 +1,178 @@
+#include "filter.h"
+
+#include "common.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define FILTER_X86
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__aarch64__) || defined(_M_ARM64)
+#define FILTER_NEON
+#include <arm_neon.h>
+#endif
+
+capture_filter::capture_filter(float sample_rate, float freq_hp, float pre_emphasis) : m_pre(pre_emphasis) {
+    m_hp = freq_hp > 0.0f && freq_hp < 0.5f*sample_rate;
+
+    // RBJ audio EQ cookbook high-pass, normalized by a0
+    const float w0    = 2.0f*3.14159265f*freq_hp/sample_rate;
+    const float alpha = sinf(w0)/(2.0f*0.70710678f);
+    const float cw    = cosf(w0);
+    const float a0    = 1.0f + alpha;
+
+    m_b0 =  (1.0f + cw)/2.0f/a0;
+    m_b1 = -(1.0f + cw)/a0;
+    m_b2 =  (1.0f + cw)/2.0f/a0;
+    m_a1 = -2.0f*cw/a0;
+    m_a2 =  (1.0f - alpha)/a0;
+}
+
+void capture_filter::reset() {
+    m_z1     = 0.0f;
+    m_z2     = 0.0f;
+    m_x_prev = 0.0f;
+}
+
+void capture_filter::process(float * samples, size_t n) {
+    if (m_hp) {
+        // state in locals so it stays in registers through the loop
+        float z1 = m_z1;
+        float z2 = m_z2;
+        for (size_t i = 0; i < n; ++i) {
+            const float x = samples[i];
+            const float y = m_b0*x + z1;
+            z1 = m_b1*x - m_a1*y + z2;
+            z2 = m_b2*x - m_a2*y;
+            samples[i] = y;
+        }
+        m_z1 = z1;
+        m_z2 = z2;
+    }
+
+    if (m_pre != 0.0f) {
+        float x_prev = m_x_prev;
+        for (size_t i = 0; i < n; ++i) {
+            const float x = samples[i];
+            samples[i] = x - m_pre*x_prev;
+            x_prev = x;
+        }
+        m_x_prev = x_prev;
+    }
+}
+
+void capture_downmix(const float * in, size_t n_frames, int n_channels, float * out) {
+    if (n_channels <= 1) {
+        memcpy(out, in, n_frames*sizeof(float));
+        return;
+    }
+
+    size_t i = 0;
+    if (n_channels == 2) {
+#if defined(FILTER_X86)
+        // two frames per load, even lanes are left, odd lanes right
+        const __m128 half = _mm_set1_ps(0.5f);
+        for (; i + 4 <= n_frames; i += 4) {
+            const __m128 a = _mm_loadu_ps(in + 2*i);
+            const __m128 b = _mm_loadu_ps(in + 2*i + 4);
+            const __m128 l = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+            const __m128 r = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+            _mm_storeu_ps(out + i, _mm_mul_ps(_mm_add_ps(l, r), half));
+        }
+#elif defined(FILTER_NEON)
+        for (; i + 4 <= n_frames; i += 4) {
+            const float32x4x2_t lr = vld2q_f32(in + 2*i);
+            vst1q_f32(out + i, vmulq_n_f32(vaddq_f32(lr.val[0], lr.val[1]), 0.5f));
+        }
+#endif
+        for (; i < n_frames; ++i) {
+            out[i] = 0.5f*(in[2*i] + in[2*i + 1]);
+        }
+        return;
+    }
+
+    const float scale = 1.0f/n_channels;
+    for (; i < n_frames; ++i) {
+        const float * frame = in + i*n_channels;
+        float sum = frame[0];
+        for (int c = 1; c < n_channels; ++c) {
+            sum += frame[c];
+        }
+        out[i] = sum*scale;
+    }
+}
+
+void capture_filter_bench(int sample_rate, float freq_hp) {
+    const size_t n_block = sample_rate/100; // 10 ms device periods
+    const size_t n       = 60*(size_t) sample_rate;
+
+    std::vector<float> x(n);
+    uint32_t rng = 1;
+    for (size_t i = 0; i < n; ++i) {
+        rng = rng*1664525u + 1013904223u;
+        x[i] = 0.1f*(float(rng >> 8)/float(1 << 24) - 0.5f);
+    }
+
+    const int n_iter = 20;
+
+    // common: over the whole buffer each time, as vad_simple does
+    std::vector<float> buf;
+    auto t_start = std::chrono::steady_clock::now();
+    for (int i = 0; i < n_iter; ++i) {
+        buf = x;
+        high_pass_filter(buf, freq_hp, (float) sample_rate);
+    }
+    const double t_common = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+
+    // capture_filter: in place, block by block, as the capture callbacks do
+    capture_filter filter((float) sample_rate, freq_hp, 0.0f);
+    t_start = std::chrono::steady_clock::now();
+    for (int i = 0; i < n_iter; ++i) {
+        buf = x;
+        for (size_t off = 0; off < n; off += n_block) {
+            filter.process(buf.data() + off, std::min(n_block, n - off));
+        }
+    }
+    const double t_filter = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+
+    printf("\n%s: %d x 60 sec of audio, high-pass at %.0f Hz\n\n", __func__, n_iter, freq_hp);
+    printf("%20s %16s\n", "filter", "Msamples / sec");
+    printf("%20s %16.1f\n", "high_pass_filter", 1e-6*n_iter*n/t_common);
+    printf("%20s %16.1f\n", "capture_filter", 1e-6*n_iter*n/t_filter);
+
+    // stereo downmix as the loopback callback runs it, against the per-sample loop it replaced
+    std::vector<float> stereo(2*n);
+    for (size_t i = 0; i < n; ++i) {
+        stereo[2*i]     = x[i];
+        stereo[2*i + 1] = x[n - 1 - i];
+    }
+    buf.resize(n);
+
+    t_start = std::chrono::steady_clock::now();
+    for (int it = 0; it < n_iter; ++it) {
+        for (size_t off = 0; off < n; off += n_block) {
+            const size_t m = std::min(n_block, n - off);
+            const float * src = stereo.data() + 2*off;
+            for (size_t i = 0; i < m; ++i) {
+                buf[off + i] = 0.5f*(src[2*i] + src[2*i + 1]);
+            }
+        }
+    }
+    const double t_loop = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+
+    t_start = std::chrono::steady_clock::now();
+    for (int it = 0; it < n_iter; ++it) {
+        for (size_t off = 0; off < n; off += n_block) {
+            capture_downmix(stereo.data() + 2*off, std::min(n_block, n - off), 2, buf.data() + off);
+        }
+    }
+    const double t_downmix = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+
+    printf("%20s %16.1f\n", "downmix loop", 1e-6*n_iter*n/t_loop);
+    printf("%20s %16.1f\n", "capture_downmix", 1e-6*n_iter*n/t_downmix);
+}
@@ -0,0 +1,74 @@
+#include "local-agreement.h"
+
+#include <algorithm>
+
+// tokens starting this many samples before the committed end still count as already committed
+// (timestamps of re-decoded words jitter by a few frames)
+#define LA_OVERLAP_SAMPLES 1600
+
+// longest run of leading tokens checked against the committed tail for duplicates
+#define LA_MAX_NGRAM 5
+
+local_agreement::local_agreement(size_t n_max_prompt) : m_n_max_prompt(n_max_prompt) {
+}
+
+std::vector<stream_token> local_agreement::update(const std::vector<stream_token> & hyp) {
+    // drop the part of the hypothesis that covers already committed audio
+    std::vector<stream_token> cur;
+    for (const auto & t : hyp) {
+        if (t.t0 > m_committed_end - LA_OVERLAP_SAMPLES) {
+            cur.push_back(t);
+        }
+    }
+
+    // the model often repeats the last committed words at the start of the window
+    const size_t n_ngram = std::min({ (size_t) LA_MAX_NGRAM, cur.size(), m_prompt.size() });
+    for (size_t n = n_ngram; n > 0; --n) {
+        bool same = true;
+        for (size_t i = 0; i < n && same; ++i) {
+            same = cur[i].id == m_prompt[m_prompt.size() - n + i];
+        }
+        if (same) {
+            cur.erase(cur.begin(), cur.begin() + n);
+            break;
+        }
+    }
+
+    // agreement with the previous hypothesis
+    size_t n_agree = 0;
+    while (n_agree < cur.size() && n_agree < m_pending.size() && cur[n_agree].id == m_pending[n_agree].id) {
+        ++n_agree;
+    }
+
+    std::vector<stream_token> res(cur.begin(), cur.begin() + n_agree);
+    commit(res.data(), res.size());
+
+    m_pending.assign(cur.begin() + n_agree, cur.end());
+
+    return res;
+}
+
+std::vector<stream_token> local_agreement::flush() {
+    std::vector<stream_token> res;
+    res.swap(m_pending);
+    commit(res.data(), res.size());
+
+    return res;
+}
+
+void local_agreement::reset() {
+    m_pending.clear();
+    m_prompt.clear();
+}
+
+void local_agreement::commit(const stream_token * tokens, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        m_prompt.push_back(tokens[i].id);
+        m_committed_end = std::max(m_committed_end, tokens[i].t1);
+    }
+    m_n_committed += n;
+
+    if (m_prompt.size() > m_n_max_prompt) {
+        m_prompt.erase(m_prompt.begin(), m_prompt.end() - m_n_max_prompt);
+    }
+}
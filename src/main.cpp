@@ -34,70 +34,62 @@
 #include "whisper.h"
 #include "ggml-backend.h"
 #include "vad.h"
+#include "vad-stream.h"
 #include "openai_client.h"
-
+#include "bounded-queue.h"
+#include "sample-pool.h"
+#include "catchup.h"
+#include "chunker.h"
+#include "filter.h"
+#include "resample.h"
+#include "mel.h"
+#include "local-agreement.h"
+#include "audio-ctx.h"
+#include "session-manager.h"
+#include "batch.h"
+#include "file-audio.h"
+#include "capture-group.h"
+
+#include <algorithm>
 #include <chrono>
 #include <cstdio>
 #include <ctime>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <sstream>
 #include <fstream>
 #include <string>
 #include <thread>
 #include <vector>
 #include <atomic>
 
-// Single-producer single-consumer ring buffer
-template<typename T>
-class RingBuffer {
-public:
-    explicit RingBuffer(size_t capacity)
-        : m_buffer(capacity + 1), m_head(0), m_tail(0) {}
-
-    bool push(T&& item) {
-        size_t head = m_head.load(std::memory_order_relaxed);
-        size_t next = (head + 1) % m_buffer.size();
-        if (next == m_tail.load(std::memory_order_acquire)) {
-            return false; // full
-        }
-        m_buffer[head] = std::move(item);
-        m_head.store(next, std::memory_order_release);
-        return true;
-    }
-
-    bool pop(T& item) {
-        size_t tail = m_tail.load(std::memory_order_relaxed);
-        if (tail == m_head.load(std::memory_order_acquire)) {
-            return false; // empty
-        }
-        item = std::move(m_buffer[tail]);
-        m_tail.store((tail + 1) % m_buffer.size(), std::memory_order_release);
-        return true;
-    }
-
-    bool empty() const {
-        return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
-    }
-
-private:
-    std::vector<T> m_buffer;
-    std::atomic<size_t> m_head;
-    std::atomic<size_t> m_tail;
-};
-
 // command-line parameters
 struct whisper_params {
     int32_t n_threads = std::thread::hardware_concurrency();//std::min(4, (int32_t) std::thread::hardware_concurrency());
     int32_t step_ms = 5000;//500;
     int32_t length_ms  = 6000;
-    int32_t keep_ms    = 1000;
+    int32_t keep_ms    = 200;
     int32_t capture_id = -1;
     int32_t max_tokens = 32;
     int32_t audio_ctx  = 0;
     int32_t beam_size  = -1;
+    int32_t max_lag_ms = 0;
+    int32_t chunk_tol_ms = 500;
+    int32_t chunk_max_ms = 0;
+    int32_t n_workers  = 0;
+    int32_t file_jitter_ms = 0;
+    int32_t echo_tail_ms   = 256;
+
+    int32_t vad_preroll_ms    = 300;
+    int32_t vad_hangover_ms   = 500;
+    int32_t vad_min_speech_ms = 200;
 
     float vad_thold    = 0.6f;
     float freq_thold   = 100.0f;
+    float pre_emphasis = 0.0f;
+    float file_speed   = 1.0f;
+    float echo_gate    = 0.8f;
 
     bool translate     = false;
     bool no_fallback   = false;
@@ -113,6 +105,18 @@ struct whisper_params {
 #endif
     bool flash_attn    = true;
     bool use_openai    = false;
+    bool mel_cache     = false;
+    bool commit        = false;
+    bool bench_vad     = false;
+    bool bench_filter  = false;
+    bool bench_resample = false;
+    bool bench_echo    = false;
+    bool stress_queue  = false;
+    bool bench_ring    = false;
+    bool bench_wait    = false;
+    bool bench_mel     = false;
+
+    queue_overflow overflow = queue_overflow::drop_oldest;
 
     std::string language  = "ko";
 
@@ -124,6 +128,16 @@ struct whisper_params {
     //std::string model = "models/ggml-large-v3-turbo.bin";
     //std::string model = "models/ggml-large-v3-turbo-q8_0.bin";
     std::string fname_out;
+    std::string file_in; // capture from a file instead of a device
+
+    std::vector<std::string> bench_ctx;
+    std::vector<std::string> replay;
+    std::vector<std::string> sources; // capture these in parallel, one session each
+    std::vector<std::string> input;
+    std::vector<std::string> vad_compare;
+
+    std::string vad_backend = "energy";
+    std::string vad_model;
 };
 
 void whisper_print_usage(int argc, char ** argv, const whisper_params & params);
@@ -142,10 +156,14 @@ static bool whisper_params_parse(int argc, char ** argv, whisper_params & params
         else if (                  arg == "--keep")          { params.keep_ms       = std::stoi(argv[++i]); }
         else if (arg == "-c"    || arg == "--capture")       { params.capture_id    = std::stoi(argv[++i]); }
         else if (arg == "-mt"   || arg == "--max-tokens")    { params.max_tokens    = std::stoi(argv[++i]); }
-        else if (arg == "-ac"   || arg == "--audio-ctx")     { params.audio_ctx     = std::stoi(argv[++i]); }
+        else if (arg == "-ac"   || arg == "--audio-ctx")     {
+            const std::string v = argv[++i];
+            params.audio_ctx = v == "auto" ? AUDIO_CTX_AUTO : std::stoi(v);
+        }
         else if (arg == "-bs"   || arg == "--beam-size")     { params.beam_size     = std::stoi(argv[++i]); }
         else if (arg == "-vth"  || arg == "--vad-thold")     { params.vad_thold     = std::stof(argv[++i]); }
         else if (arg == "-fth"  || arg == "--freq-thold")    { params.freq_thold    = std::stof(argv[++i]); }
+        else if (arg == "-pe"   || arg == "--pre-emphasis")  { params.pre_emphasis  = std::stof(argv[++i]); }
         else if (arg == "-tr"   || arg == "--translate")     { params.translate     = true; }
         else if (arg == "-nf"   || arg == "--no-fallback")   { params.no_fallback   = true; }
         else if (arg == "-ps"   || arg == "--print-special") { params.print_special = true; }
@@ -157,6 +175,54 @@ static bool whisper_params_parse(int argc, char ** argv, whisper_params & params
         else if (arg == "-sa"   || arg == "--save-audio")    { params.save_audio    = true; }
         else if (arg == "-ng"   || arg == "--no-gpu")        { params.use_gpu       = false; }
         else if (arg == "-fa"   || arg == "--flash-attn")    { params.flash_attn    = true; }
+        else if (arg == "-mc"   || arg == "--mel-cache")     { params.mel_cache     = true; }
+        else if (arg == "-cm"   || arg == "--commit")        { params.commit        = true; }
+        else if (                  arg == "--vad-pre")       { params.vad_preroll_ms    = std::stoi(argv[++i]); }
+        else if (                  arg == "--vad-hang")      { params.vad_hangover_ms   = std::stoi(argv[++i]); }
+        else if (                  arg == "--vad-min")       { params.vad_min_speech_ms = std::stoi(argv[++i]); }
+        else if (                  arg == "--vad-backend")   { params.vad_backend   = argv[++i]; }
+        else if (                  arg == "--vad-model")     { params.vad_model     = argv[++i]; }
+        else if (                  arg == "--vad-compare")   { params.vad_compare.push_back(argv[++i]); }
+        else if (                  arg == "--bench-filter")  { params.bench_filter  = true; }
+        else if (                  arg == "--bench-resample") { params.bench_resample = true; }
+        else if (                  arg == "--bench-vad")     { params.bench_vad     = true; }
+        else if (                  arg == "--bench-echo")    { params.bench_echo    = true; }
+        else if (                  arg == "--stress-queue")  { params.stress_queue  = true; }
+        else if (                  arg == "--bench-ring")    { params.bench_ring    = true; }
+        else if (                  arg == "--bench-wait")    { params.bench_wait    = true; }
+        else if (                  arg == "--bench-mel")     { params.bench_mel     = true; }
+        else if (                  arg == "--bench-ctx")     { params.bench_ctx.push_back(argv[++i]); }
+        else if (                  arg == "--input")         {
+            while (i + 1 < argc && argv[i + 1][0] != '-') {
+                params.input.push_back(argv[++i]);
+            }
+        }
+        else if (                  arg == "--replay")        { params.replay.push_back(argv[++i]); }
+        else if (                  arg == "--sources")       {
+            std::stringstream ss(argv[++i]);
+            std::string name;
+            while (std::getline(ss, name, ',')) {
+                if (!name.empty()) {
+                    params.sources.push_back(name);
+                }
+            }
+        }
+        else if (                  arg == "--echo-tail")     { params.echo_tail_ms  = std::stoi(argv[++i]); }
+        else if (                  arg == "--echo-gate")     { params.echo_gate     = std::stof(argv[++i]); }
+        else if (                  arg == "--capture-file")  { params.file_in       = argv[++i]; }
+        else if (                  arg == "--file-speed")    { params.file_speed    = std::stof(argv[++i]); }
+        else if (                  arg == "--file-jitter")   { params.file_jitter_ms = std::stoi(argv[++i]); }
+        else if (                  arg == "--workers")       { params.n_workers     = std::stoi(argv[++i]); }
+        else if (                  arg == "--chunk-tol")     { params.chunk_tol_ms  = std::stoi(argv[++i]); }
+        else if (                  arg == "--chunk-max")     { params.chunk_max_ms  = std::stoi(argv[++i]); }
+        else if (                  arg == "--max-lag")       { params.max_lag_ms    = std::stoi(argv[++i]); }
+        else if (                  arg == "--overflow")      {
+            if (!queue_overflow_parse(argv[++i], params.overflow)) {
+                fprintf(stderr, "error: unknown overflow policy: %s\n", argv[i]);
+                whisper_print_usage(argc, argv, params);
+                exit(0);
+            }
+        }
 
         else {
             fprintf(stderr, "error: unknown argument: %s\n", arg.c_str());
@@ -175,15 +241,16 @@ void whisper_print_usage(int /*argc*/, char ** argv, const whisper_params & para
     fprintf(stderr, "options:\n");
     fprintf(stderr, "  -h,       --help          [default] show this help message and exit\n");
     fprintf(stderr, "  -t N,     --threads N     [%-7d] number of threads to use during computation\n",    params.n_threads);
-    fprintf(stderr, "            --step N        [%-7d] audio step size in milliseconds\n",                params.step_ms);
+    fprintf(stderr, "            --step N        [%-7d] audio step size in milliseconds, 0 for VAD only\n", params.step_ms);
     fprintf(stderr, "            --length N      [%-7d] audio length in milliseconds\n",                   params.length_ms);
     fprintf(stderr, "            --keep N        [%-7d] audio to keep from previous step in ms\n",         params.keep_ms);
     fprintf(stderr, "  -c ID,    --capture ID    [%-7d] capture device ID\n",                              params.capture_id);
     fprintf(stderr, "  -mt N,    --max-tokens N  [%-7d] maximum number of tokens per audio chunk\n",       params.max_tokens);
-    fprintf(stderr, "  -ac N,    --audio-ctx N   [%-7d] audio context size (0 - all)\n",                   params.audio_ctx);
+    fprintf(stderr, "  -ac N,    --audio-ctx N   [%-7d] audio context size (0 - all, -1/auto - per window)\n",                   params.audio_ctx);
     fprintf(stderr, "  -bs N,    --beam-size N   [%-7d] beam size for beam search\n",                      params.beam_size);
     fprintf(stderr, "  -vth N,   --vad-thold N   [%-7.2f] voice activity detection threshold\n",           params.vad_thold);
     fprintf(stderr, "  -fth N,   --freq-thold N  [%-7.2f] high-pass frequency cutoff\n",                   params.freq_thold);
+    fprintf(stderr, "  -pe N,    --pre-emphasis N[%-7.2f] pre-emphasis coefficient applied at capture (0 - off)\n", params.pre_emphasis);
     fprintf(stderr, "  -tr,      --translate     [%-7s] translate from source language to english\n",      params.translate ? "true" : "false");
     fprintf(stderr, "  -nf,      --no-fallback   [%-7s] do not use temperature fallback while decoding\n", params.no_fallback ? "true" : "false");
     fprintf(stderr, "  -ps,      --print-special [%-7s] print special tokens\n",                           params.print_special ? "true" : "false");
@@ -195,6 +262,36 @@ void whisper_print_usage(int /*argc*/, char ** argv, const whisper_params & para
     fprintf(stderr, "  -sa,      --save-audio    [%-7s] save the recorded audio to a file\n",              params.save_audio ? "true" : "false");
     fprintf(stderr, "  -ng,      --no-gpu        [%-7s] disable GPU inference\n",                          params.use_gpu ? "false" : "true");
     fprintf(stderr, "  -fa,      --flash-attn    [%-7s] flash attention during inference\n",               params.flash_attn ? "true" : "false");
+    fprintf(stderr, "  -mc,      --mel-cache     [%-7s] reuse log-mel frames of the overlap between steps\n", params.mel_cache ? "true" : "false");
+    fprintf(stderr, "  -cm,      --commit        [%-7s] emit text once two consecutive steps agree on it (sliding window)\n", params.commit ? "true" : "false");
+    fprintf(stderr, "            --vad-pre N     [%-7d] audio kept before a speech onset in ms\n", params.vad_preroll_ms);
+    fprintf(stderr, "            --vad-hang N    [%-7d] silence before a speech region ends in ms\n", params.vad_hangover_ms);
+    fprintf(stderr, "            --vad-min N     [%-7d] speech needed to start a region in ms\n", params.vad_min_speech_ms);
+    fprintf(stderr, "            --vad-backend B [%-7s] VAD backend: energy, fixed, spectral, simple, silero\n", params.vad_backend.c_str());
+    fprintf(stderr, "            --vad-model F   [%-7s] Silero VAD model path\n", params.vad_model.c_str());
+    fprintf(stderr, "            --vad-compare F [%-7s] compare the VAD backends on WAV file F, labels from F.lab (repeatable)\n", "");
+    fprintf(stderr, "            --bench-filter  [%-7s] benchmark the capture filter and exit\n", params.bench_filter ? "true" : "false");
+    fprintf(stderr, "            --bench-resample [%-6s] benchmark the capture resampler and exit\n", params.bench_resample ? "true" : "false");
+    fprintf(stderr, "            --bench-vad     [%-7s] benchmark the VAD kernels and the spectral front-end and exit\n", params.bench_vad ? "true" : "false");
+    fprintf(stderr, "            --bench-echo    [%-7s] benchmark the echo canceller and exit\n", params.bench_echo ? "true" : "false");
+    fprintf(stderr, "            --bench-ring    [%-7s] benchmark the capture callback against a reading consumer and exit\n", params.bench_ring ? "true" : "false");
+    fprintf(stderr, "            --bench-wait    [%-7s] benchmark waking up for a capture step or a queued chunk against polling and exit\n", params.bench_wait ? "true" : "false");
+    fprintf(stderr, "            --bench-mel     [%-7s] benchmark the log-mel front-end per step with and without --mel-cache and exit\n", params.bench_mel ? "true" : "false");
+    fprintf(stderr, "            --stress-queue  [%-7s] run the audio queue against a slow consumer with every --overflow policy and exit\n", params.stress_queue ? "true" : "false");
+    fprintf(stderr, "            --bench-ctx F   [%-7s] benchmark the audio_ctx buckets on WAV file F (repeatable)\n", "");
+    fprintf(stderr, "            --input F ...   [%-7s] transcribe files or directories offline and exit\n", "");
+    fprintf(stderr, "            --replay F      [%-7s] replay WAV file F as a real-time session (repeatable)\n", "");
+    fprintf(stderr, "            --sources A,B   [%-7s] capture in parallel, one session each: mic (local), system (remote) or a file\n", "");
+    fprintf(stderr, "            --echo-tail N   [%-7d] cancel the system audio echo in the mic of --sources, tail in ms (0 - off)\n", params.echo_tail_ms);
+    fprintf(stderr, "            --echo-gate X   [%-7.2f] drop mic chunks with more than X of their energy from system audio (1 - off)\n", params.echo_gate);
+    fprintf(stderr, "            --capture-file F [%-7s] capture from audio file F instead of a device, '-' for raw s16 on stdin\n", params.file_in.c_str());
+    fprintf(stderr, "            --file-speed X  [%-7.1f] replay speed of --capture-file, 0 for as fast as possible\n", params.file_speed);
+    fprintf(stderr, "            --file-jitter N [%-7d] delay --capture-file periods randomly by up to N ms\n", params.file_jitter_ms);
+    fprintf(stderr, "            --workers N     [%-7d] inference workers for --input/--replay/--sources (0 - auto)\n", params.n_workers);
+    fprintf(stderr, "            --chunk-tol N   [%-7d] cut chunks at the quietest point within N ms of --step (0 - exact)\n", params.chunk_tol_ms);
+    fprintf(stderr, "            --chunk-max N   [%-7d] longest chunk in ms when there is no pause (0 - 2 x step, or x length with --step 0)\n", params.chunk_max_ms);
+    fprintf(stderr, "            --max-lag N     [%-7d] skip ahead when inference lags more than N ms (0 - never)\n", params.max_lag_ms);
+    fprintf(stderr, "            --overflow P    [%-7s] audio queue overflow: drop-oldest, drop-newest, block, coalesce\n", queue_overflow_name(params.overflow));
     fprintf(stderr, "\n");
 }
 
@@ -212,15 +309,23 @@ int main(int argc, char ** argv) {
         return 1;
     }
 
+    const bool use_vad = params.step_ms <= 0; // VAD only instead of the sliding window
+
+    // VAD only: speech regions are transcribed whole, cut at a pause only beyond --length, and
+    // the capture is still read in steps, short ones so the end of a region is seen soon
+    const int chunk_ms = use_vad ? params.length_ms : params.step_ms;
+    if (use_vad) {
+        params.step_ms = 100;
+    }
+
     //params.keep_ms   = std::min(params.keep_ms,   params.step_ms);
     params.length_ms = std::max(params.length_ms, params.step_ms);
 
-    const int n_samples_step = (1e-3*params.step_ms  )*WHISPER_SAMPLE_RATE;
-    const int n_samples_len  = (1e-3*params.length_ms)*WHISPER_SAMPLE_RATE;
-    const int n_samples_keep = (1e-3*params.keep_ms  )*WHISPER_SAMPLE_RATE;
-    const int n_samples_30s  = (1e-3*30000.0         )*WHISPER_SAMPLE_RATE;
-
-    const bool use_vad = n_samples_step <= 0; // sliding window mode uses VAD
+    const int n_samples_step  = (1e-3*params.step_ms  )*WHISPER_SAMPLE_RATE;
+    const int n_samples_chunk = (1e-3*chunk_ms        )*WHISPER_SAMPLE_RATE;
+    const int n_samples_len   = (1e-3*params.length_ms)*WHISPER_SAMPLE_RATE;
+    const int n_samples_keep  = (1e-3*params.keep_ms  )*WHISPER_SAMPLE_RATE;
+    const int n_samples_30s   = (1e-3*30000.0         )*WHISPER_SAMPLE_RATE;
 
     const int n_new_line = !use_vad ? std::max(1, params.length_ms / params.step_ms - 1) : 1; // number of steps to print new line
 
@@ -228,13 +333,251 @@ int main(int argc, char ** argv) {
     params.no_context    |= use_vad;
     params.max_tokens     = 0;
 
-    // select and init audio source
-    std::cout << "Select input source (0: microphone, 1: system audio): ";
+    vad_backend_params bparams;
+    bparams.sample_rate = WHISPER_SAMPLE_RATE;
+    bparams.vad_thold   = params.vad_thold;
+    bparams.freq_thold  = params.freq_thold;
+    bparams.model       = params.vad_model;
+
+    vad_stream_params vparams;
+    vparams.sample_rate   = WHISPER_SAMPLE_RATE;
+    vparams.pre_roll_ms   = params.vad_preroll_ms;
+    vparams.hangover_ms   = params.vad_hangover_ms;
+    vparams.min_speech_ms = params.vad_min_speech_ms;
+
+    if (!params.vad_compare.empty()) {
+        std::vector<std::string> backends = { "energy", "fixed", "spectral", "simple" };
+        if (!params.vad_model.empty()) {
+            backends.push_back("silero");
+        }
+        return vad_compare(params.vad_compare, backends, bparams, vparams) ? 0 : 1;
+    }
+
+    if (params.bench_resample) {
+        resampler_bench(WHISPER_SAMPLE_RATE);
+        return 0;
+    }
+
+    if (params.bench_ring) {
+        audio_ring_bench(WHISPER_SAMPLE_RATE);
+        return 0;
+    }
+
+    if (params.bench_wait) {
+        audio_ring_wait_bench(WHISPER_SAMPLE_RATE);
+        return 0;
+    }
+
+    if (params.bench_mel) {
+        mel_cache_bench(WHISPER_SAMPLE_RATE);
+        return 0;
+    }
+
+    if (params.stress_queue) {
+        pcm_queue_stress(WHISPER_SAMPLE_RATE);
+        return 0;
+    }
+
+    if (params.bench_echo) {
+        echo_canceller_bench(WHISPER_SAMPLE_RATE);
+        return 0;
+    }
+
+    if (params.bench_filter) {
+        capture_filter_bench(WHISPER_SAMPLE_RATE, params.freq_thold);
+        return 0;
+    }
+
+    if (params.bench_vad) {
+        vad_bench(WHISPER_SAMPLE_RATE);
+        vad_backend_spectral::bench(WHISPER_SAMPLE_RATE);
+        return 0;
+    }
+
+    if (!params.bench_ctx.empty()) {
+        struct whisper_context_params cparams = whisper_context_default_params();
+        cparams.use_gpu    = params.use_gpu;
+        cparams.flash_attn = params.flash_attn;
+
+        struct whisper_context * ctx = whisper_init_from_file_with_params(params.model.c_str(), cparams);
+        if (ctx == nullptr) {
+            fprintf(stderr, "error: failed to initialize whisper context\n");
+            return 2;
+        }
+
+        whisper_full_params wparams = whisper_full_default_params(WHISPER_SAMPLING_GREEDY);
+        wparams.print_progress = false;
+        wparams.print_realtime = false;
+        wparams.single_segment = true;
+        wparams.language       = params.language.c_str();
+        wparams.translate      = params.translate;
+        wparams.n_threads      = params.n_threads;
+
+        const bool ok = audio_ctx_bench(ctx, wparams, params.bench_ctx, n_samples_len);
+        whisper_free(ctx);
+        return ok ? 0 : 1;
+    }
+
+    if (!params.input.empty()) {
+        struct whisper_context_params cparams = whisper_context_default_params();
+        cparams.use_gpu    = params.use_gpu;
+        cparams.flash_attn = params.flash_attn;
+
+        struct whisper_context * ctx = whisper_init_from_file_with_params_no_state(params.model.c_str(), cparams);
+        if (ctx == nullptr) {
+            fprintf(stderr, "error: failed to initialize whisper context\n");
+            return 2;
+        }
+
+        const int n_workers = params.n_workers > 0 ? params.n_workers : std::max(1, params.n_threads/4);
+
+        whisper_full_params wparams = whisper_full_default_params(params.beam_size > 1 ? WHISPER_SAMPLING_BEAM_SEARCH : WHISPER_SAMPLING_GREEDY);
+        wparams.print_progress   = false;
+        wparams.print_realtime   = false;
+        wparams.language         = params.language.c_str();
+        wparams.translate        = params.translate;
+        wparams.n_threads        = std::max(1, params.n_threads/n_workers);
+        wparams.beam_search.beam_size = params.beam_size;
+        wparams.temperature_inc  = params.no_fallback ? 0.0f : wparams.temperature_inc;
+
+        const bool ok = batch_transcribe(ctx, wparams, params.input, n_workers, n_samples_30s, params.fname_out);
+        whisper_free(ctx);
+        return ok ? 0 : 1;
+    }
+
+    if (!params.replay.empty()) {
+        struct whisper_context_params cparams = whisper_context_default_params();
+        cparams.use_gpu    = params.use_gpu;
+        cparams.flash_attn = params.flash_attn;
+
+        // weights only, every session brings its own state
+        struct whisper_context * ctx = whisper_init_from_file_with_params_no_state(params.model.c_str(), cparams);
+        if (ctx == nullptr) {
+            fprintf(stderr, "error: failed to initialize whisper context\n");
+            return 2;
+        }
+
+        const int n_streams = (int) params.replay.size();
+        const int n_workers = params.n_workers > 0 ? params.n_workers : std::min(n_streams, std::max(1, params.n_threads/4));
+
+        whisper_full_params wparams = whisper_full_default_params(WHISPER_SAMPLING_GREEDY);
+        wparams.print_progress = false;
+        wparams.print_realtime = false;
+        wparams.language       = params.language.c_str();
+        wparams.translate      = params.translate;
+        wparams.n_threads      = std::max(1, params.n_threads/n_workers);
+        wparams.audio_ctx      = params.audio_ctx == AUDIO_CTX_AUTO ? audio_ctx_bucket(n_samples_len) : params.audio_ctx;
+
+        const bool ok = session_replay(ctx, wparams, params.replay, n_workers, n_samples_len);
+        whisper_free(ctx);
+        return ok ? 0 : 1;
+    }
+
+    if (!params.sources.empty()) {
+        struct whisper_context_params cparams = whisper_context_default_params();
+        cparams.use_gpu    = params.use_gpu;
+        cparams.flash_attn = params.flash_attn;
+
+        // weights only, every source brings its own state
+        struct whisper_context * ctx = whisper_init_from_file_with_params_no_state(params.model.c_str(), cparams);
+        if (ctx == nullptr) {
+            fprintf(stderr, "error: failed to initialize whisper context\n");
+            return 2;
+        }
+
+        const int n_sources = (int) params.sources.size();
+        const int n_workers = params.n_workers > 0 ? params.n_workers : std::min(n_sources, std::max(1, params.n_threads/4));
+        const int chunk_max_ms = params.chunk_max_ms > 0 ? params.chunk_max_ms : 2*chunk_ms;
+
+        whisper_full_params wparams = whisper_full_default_params(WHISPER_SAMPLING_GREEDY);
+        wparams.print_progress = false;
+        wparams.print_realtime = false;
+        wparams.language       = params.language.c_str();
+        wparams.translate      = params.translate;
+        wparams.n_threads      = std::max(1, params.n_threads/n_workers);
+        wparams.audio_ctx      = params.audio_ctx == AUDIO_CTX_AUTO ? audio_ctx_bucket((size_t) chunk_max_ms*WHISPER_SAMPLE_RATE/1000) : params.audio_ctx;
+
+        // the capture filter already removed the low end
+        bparams.freq_thold = 0.0f;
+
+        capture_group group(vparams, params.step_ms, chunk_ms, params.chunk_tol_ms, chunk_max_ms);
+        int i_mic    = -1;
+        int i_system = -1;
+        for (const auto & name : params.sources) {
+            std::unique_ptr<audio_capture> source;
+            if (name == "mic") {
+                source = std::make_unique<audio_async>(params.length_ms);
+            } else if (name == "system") {
+                source = std::make_unique<system_audio_async>(params.length_ms);
+            } else {
+                source = std::make_unique<file_audio_capture>(params.length_ms, name, params.file_speed, params.file_jitter_ms);
+            }
+
+            if (!source->init(params.capture_id, WHISPER_SAMPLE_RATE)) {
+                fprintf(stderr, "%s: failed to open source '%s'\n", __func__, name.c_str());
+                whisper_free(ctx);
+                return 1;
+            }
+            source->set_filter(params.freq_thold, params.pre_emphasis);
+
+            std::unique_ptr<vad_backend> backend = vad_backend_create(params.vad_backend, bparams);
+            if (!backend) {
+                fprintf(stderr, "%s: unknown or unavailable VAD backend '%s'\n", __func__, params.vad_backend.c_str());
+                whisper_free(ctx);
+                return 1;
+            }
+
+            const int i = (int) group.add(capture_group_label(name), std::move(source), std::move(backend));
+            if (name == "mic") {
+                i_mic = i;
+            } else if (name == "system") {
+                i_system = i;
+            }
+        }
+
+        // through speakers the mic hears the remote side as well, which system audio already has
+        if (i_mic >= 0 && i_system >= 0 && params.echo_tail_ms > 0) {
+            echo_params eparams;
+            eparams.tail_ms = params.echo_tail_ms;
+            group.set_echo_reference(i_mic, i_system, eparams, params.echo_gate);
+        }
+
+        bool ok = true;
+        {
+            std::mutex print_mutex;
+            session_manager manager(ctx, wparams, n_workers, [&](const session_result & res) {
+                std::lock_guard<std::mutex> lock(print_mutex);
+                printf("[%s --> %s] [%s] %s\n",
+                        to_timestamp(res.t0*100/WHISPER_SAMPLE_RATE).c_str(),
+                        to_timestamp(res.t1*100/WHISPER_SAMPLE_RATE).c_str(),
+                        group.label(res.id).c_str(), res.text.c_str());
+                fflush(stdout);
+            });
+
+            ok = group.start(manager);
+            if (ok) {
+                group.run(manager, [] { return sdl_poll_events(); });
+                group.print_stats();
+            }
+        }
+
+        whisper_free(ctx);
+        return ok ? 0 : 1;
+    }
+
+    // select and init audio source, a file source runs unattended
+    const bool use_file = !params.file_in.empty();
+
     int audio_choice = 0;
-    std::cin >> audio_choice;
+    if (!use_file) {
+        std::cout << "Select input source (0: microphone, 1: system audio): ";
+        std::cin >> audio_choice;
+    }
 
     std::unique_ptr<audio_capture> audio;
-    if (audio_choice == 1) {
+    if (use_file) {
+        audio = std::make_unique<file_audio_capture>(params.length_ms, params.file_in, params.file_speed, params.file_jitter_ms);
+    } else if (audio_choice == 1) {
         audio = std::make_unique<system_audio_async>(params.length_ms);
     } else {
         audio = std::make_unique<audio_async>(params.length_ms);
@@ -245,11 +588,19 @@ int main(int argc, char ** argv) {
         return 1;
     }
 
-    audio->resume();
+    // high-pass (and pre-emphasis) once at capture, everything downstream reads filtered audio
+    audio->set_filter(params.freq_thold, params.pre_emphasis);
+
+    // a file starts playing once the pipeline is ready, see below
+    if (!use_file) {
+        audio->resume();
+    }
 
-    std::cout << "Select inference engine (0: local model, 1: OpenAI API): ";
     int engine_choice = 0;
-    std::cin >> engine_choice;
+    if (!use_file) {
+        std::cout << "Select inference engine (0: local model, 1: OpenAI API): ";
+        std::cin >> engine_choice;
+    }
     params.use_openai = (engine_choice == 1);
 
     // whisper init
@@ -273,8 +624,6 @@ int main(int argc, char ** argv) {
         }
     }
 
-    std::vector<float> pcmf32_new(n_samples_30s, 0.0f);
-
     std::vector<whisper_token> prompt_tokens;
 
     // print some info about the processing
@@ -333,7 +682,71 @@ int main(int argc, char ** argv) {
         wavWriter.open(filename, WHISPER_SAMPLE_RATE, 16, 1);
     }
 
-    RingBuffer<std::vector<float>> audio_queue(8);
+    // only speech regions, with their pre-roll, are queued for inference
+    // the capture filter already removed the low end
+    bparams.freq_thold = 0.0f;
+
+    std::unique_ptr<vad_backend> backend = vad_backend_create(params.vad_backend, bparams);
+    if (!backend) {
+        fprintf(stderr, "%s: unknown or unavailable VAD backend '%s'\n", __func__, params.vad_backend.c_str());
+        return 1;
+    }
+    vad_stream vad(vparams, std::move(backend));
+    std::vector<vad_event> vad_events;
+    std::vector<float>     vad_speech;
+    vad_speech.reserve(vad.max_forward(n_samples_step));
+
+
+    // speech regions are cut into chunks that end in pauses
+    silence_chunker chunker(WHISPER_SAMPLE_RATE, chunk_ms, params.chunk_tol_ms,
+                            params.chunk_max_ms > 0 ? params.chunk_max_ms : 2*chunk_ms);
+
+    // capture blocks are recycled through pcm_pool, so streaming does not hit the heap once warmed up
+    // when inference falls behind, --overflow decides what happens to new chunks; coalescing
+    // stays within one block and never joins audio across a gap
+    const size_t n_queue = 8;
+    const size_t n_block = chunker.n_max();
+    pcm_pool audio_pool(n_queue + 2, n_block);
+    bounded_queue<pcm_chunk> audio_queue(n_queue, params.overflow, params.step_ms,
+        [n_block](pcm_chunk & dst, pcm_chunk & src) { return pcm_chunk_merge(dst, src, n_block); });
+
+    // inference working buffers are sized up front and only ever resized within their capacity
+    pcm_block pcmf32;
+    pcm_block pcmf32_old;
+    pcmf32    .reserve(n_samples_30s);
+    pcmf32_old.reserve(n_samples_30s);
+
+    // --audio-ctx auto: number of calls and inference time per encoder context bucket
+    const std::vector<int> & ctx_buckets = audio_ctx_buckets();
+    std::vector<int>    ctx_n_calls(ctx_buckets.size(), 0);
+    std::vector<double> ctx_t_ms(ctx_buckets.size(), 0.0);
+
+    // log-mel frames of the audio that overlaps between steps are computed only once
+    std::unique_ptr<mel_cache> mel;
+    std::vector<float>         mel_data;
+    double                     t_mel_ms = 0.0;
+    if (ctx && params.mel_cache) {
+        mel = std::make_unique<mel_cache>(whisper_model_n_mels(ctx), WHISPER_SAMPLE_RATE, n_samples_30s/WHISPER_MEL_HOP + 100);
+        mel_data.reserve((size_t) whisper_model_n_mels(ctx)*(2*n_samples_30s/WHISPER_MEL_HOP));
+    }
+
+    // commit mode: only the unconfirmed tail of the transcript is decoded again each step
+    const bool use_commit = params.commit && !use_vad;
+    local_agreement agreement;
+    uint64_t n_decoded = 0;
+    uint64_t n_steps   = 0;
+
+    // audio waiting for inference, handed to whisper in windows of at most 30 s
+    catchup_buffer backlog(n_samples_30s, (size_t) ((1e-3*params.max_lag_ms)*WHISPER_SAMPLE_RATE));
+
+    // set once a finite source ended: inference stops when the queue has drained
+    std::atomic<bool> draining(false);
+
+    // from the newest audio of a window being queued to its text
+    double   latency_ms_sum = 0.0;
+    double   latency_ms_max = 0.0;
+    uint64_t n_latency      = 0;
+
     std::thread inference_thread([&]() {
         if (params.use_openai) {
             OpenAIRealtimeClient client(params.language);
@@ -341,16 +754,16 @@ int main(int argc, char ** argv) {
                 is_running.store(false);
                 return;
             }
-            std::vector<float> chunk;
+            pcm_chunk chunk;
             std::string text;
             while (is_running.load()) {
-                if (audio_queue.pop(chunk)) {
+                // bounded wait so incoming transcripts are still polled while no audio arrives
+                if (audio_queue.pop_wait(chunk, 20)) {
                     if (params.save_audio) {
-                        wavWriter.write(chunk.data(), chunk.size());
+                        wavWriter.write(chunk.pcm.data(), chunk.pcm.size());
                     }
-                    client.send_audio(chunk);
-                } else {
-                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    client.send_audio(chunk.pcm.data(), chunk.pcm.size());
+                    audio_pool.release(std::move(chunk.pcm));
                 }
                 while (client.receive_transcript(text)) {
                     timestamped_print("%s", text.c_str());
@@ -365,42 +778,169 @@ int main(int argc, char ** argv) {
             return;
         }
 
-        std::vector<float> pcmf32(n_samples_30s, 0.0f);
-        std::vector<float> pcmf32_old;
-        std::vector<float> pcmf32_new_local;
+        pcm_chunk chunk;
+        int64_t   chunk_end = -1; // absolute end of the last chunk, to spot gaps between regions
+
+        // a marker or a chunk after a gap ends the top-up of the backlog, it is taken next
+        pcm_chunk held;
+        bool      has_held = false;
+        auto      t_ready   = std::chrono::steady_clock::now();
         std::string sentence;
         int n_iter = 0;
-        while (is_running.load()) {
-            if (!audio_queue.pop(pcmf32_new_local)) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(1));
-                continue;
+
+        // commit mode output: stable text is printed once, the pending tail is drawn dimmed
+        // after a saved cursor position and erased again on the next update
+        bool line_open = false;
+        auto commit_print = [&](const std::vector<stream_token> & stable) {
+            if (!line_open) {
+                time_t nowt = time(nullptr);
+                char buf[32];
+                strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", localtime(&nowt));
+                printf("[%s] \33[s", buf);
+                line_open = true;
+            }
+            printf("\33[u\33[K");
+            for (const auto & t : stable) {
+                printf("%s", t.text.c_str());
+                sentence += t.text;
             }
-            if (pcmf32_new_local.empty()) {
+            printf("\33[s%s", k_styles[2].c_str());
+            for (const auto & t : agreement.pending()) {
+                printf("%s", t.text.c_str());
+            }
+            printf("\33[0m");
+        };
+        auto commit_end_line = [&]() {
+            if (!line_open) {
+                return;
+            }
+            printf("\33[u\33[K\n");
+            line_open = false;
+            if (!sentence.empty()) {
+                time_t nowt = time(nullptr);
+                char buf[32];
+                strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", localtime(&nowt));
+                if (log_file.is_open()) {
+                    log_file << "[" << buf << "] " << sentence << std::endl;
+                }
+                if (fout.is_open()) {
+                    fout << "[" << buf << "] " << sentence << std::endl;
+                }
+            }
+            sentence.clear();
+        };
+
+        // end of a speech region, or a jump in the audio: close the line and start without context
+        auto end_line = [&]() {
+            if (use_commit) {
+                commit_print(agreement.flush());
+                commit_end_line();
+                agreement.reset();
+            } else {
                 printf("\n");
-                pcmf32_old.clear();
-                if (!params.no_context) {
-                    prompt_tokens.clear();
+            }
+            pcmf32_old.clear();
+            if (!params.no_context) {
+                prompt_tokens.clear();
+            }
+            n_iter = 0;
+        };
+
+        while (is_running.load()) {
+            if (backlog.empty()) {
+                if (has_held) {
+                    chunk    = std::move(held);
+                    has_held = false;
+                } else if (!audio_queue.pop_wait(chunk, 100)) {
+                    if (draining.load() && audio_queue.empty()) {
+                        break;
+                    }
+                    continue;
+                }
+                const bool is_silence = chunk.pcm.empty();
+                t_ready = chunk.t_ready;
+
+                // a chunk after a pause shares no audio with the previous window, no need to overlap
+                if (!use_commit && chunk.pos >= 0 && chunk_end >= 0 && chunk.pos != chunk_end) {
+                    pcmf32_old.clear();
+                }
+                chunk_end = chunk.pos >= 0 ? chunk.pos + (int64_t) chunk.pcm.size() : -1;
+
+                backlog.push(chunk.pcm.data(), chunk.pcm.size());
+                audio_pool.release(std::move(chunk.pcm));
+
+                if (is_silence) {
+                    end_line();
+                    continue;
                 }
-                n_iter = 0;
-                continue;
             }
-            std::vector<float> backlog;
-            while (audio_queue.pop(backlog)) {
-                pcmf32_new_local.insert(
-                    pcmf32_new_local.end(),
-                    backlog.begin(), backlog.end());
+
+            // top the backlog up to one model window, anything beyond stays queued
+            // the window stops at a marker or a gap, which are handled as above on the next round
+            while (!has_held && !backlog.full() && audio_queue.pop(chunk)) {
+                if (chunk.pcm.empty() || (chunk.pos >= 0 && chunk_end >= 0 && chunk.pos != chunk_end)) {
+                    held     = std::move(chunk);
+                    has_held = true;
+                    break;
+                }
+                chunk_end = chunk.pos >= 0 ? chunk.pos + (int64_t) chunk.pcm.size() : -1;
+                t_ready   = chunk.t_ready;
+                backlog.push(chunk.pcm.data(), chunk.pcm.size());
+                audio_pool.release(std::move(chunk.pcm));
+            }
+
+            const size_t n_lag = backlog.size() + (has_held ? held.pcm.size() : 0) + audio_queue.size()*n_samples_chunk;
+            if (backlog.behind(n_lag)) {
+                // past the deadline - jump to the most recent audio and start a fresh context
+                // chunks before the last marker or gap are dropped whole, so the window never spans one
+                size_t n_skip = 0;
+                while (has_held || audio_queue.pop(chunk)) {
+                    if (has_held) {
+                        chunk    = std::move(held);
+                        has_held = false;
+                    }
+                    if (chunk.pcm.empty() || (chunk.pos >= 0 && chunk_end >= 0 && chunk.pos != chunk_end)) {
+                        n_skip += backlog.skip(0);
+                    }
+                    chunk_end = chunk.pos >= 0 ? chunk.pos + (int64_t) chunk.pcm.size() : -1;
+                    t_ready   = chunk.t_ready;
+                    backlog.push(chunk.pcm.data(), chunk.pcm.size());
+                    audio_pool.release(std::move(chunk.pcm));
+
+                    // trim as we go, so the backlog stays within its reserve
+                    n_skip += backlog.skip(n_samples_len);
+                }
+                end_line();
+                fprintf(stderr, "%s: WARNING: %.1f sec behind real-time, skipped %.1f sec of audio\n",
+                        __func__, float(n_lag)/WHISPER_SAMPLE_RATE, float(n_skip)/WHISPER_SAMPLE_RATE);
+                if (backlog.empty()) {
+                    continue;
+                }
+            } else if ((int) n_lag > 2*n_samples_chunk) {
+                fprintf(stderr, "\n%s: catching up, %.1f sec behind real-time\n", __func__, float(n_lag)/WHISPER_SAMPLE_RATE);
             }
+
+            const float * pcmf32_new_local = backlog.window();
+            const int n_samples_new = backlog.window_size();
+            const int64_t pos_new   = backlog.position();
+
             if (params.save_audio) {
-                wavWriter.write(pcmf32_new_local.data(), pcmf32_new_local.size());
+                wavWriter.write(pcmf32_new_local, n_samples_new);
             }
-            const int n_samples_new = pcmf32_new_local.size();
-            const int n_samples_take = std::min((int) pcmf32_old.size(), std::max(0, n_samples_keep + n_samples_len - n_samples_new));
-            pcmf32.resize(n_samples_new + n_samples_take);
-            for (int i = 0; i < n_samples_take; i++) {
-                pcmf32[i] = pcmf32_old[pcmf32_old.size() - n_samples_take + i];
+            int n_samples_take = std::min({ (int) pcmf32_old.size(), std::max(0, n_samples_keep + n_samples_len - n_samples_new), n_samples_30s - n_samples_new });
+            if (use_commit) {
+                // the whole uncommitted tail is transcribed again
+                n_samples_take = std::min((int) pcmf32_old.size(), n_samples_30s - n_samples_new);
+            }
+            if (mel) {
+                // start the window on a hop boundary so its frames line up with the cached ones
+                n_samples_take = mel_align_take(pos_new, n_samples_take);
             }
-            memcpy(pcmf32.data() + n_samples_take, pcmf32_new_local.data(), n_samples_new*sizeof(float));
-            pcmf32_old = pcmf32;
+            pcmf32.resize(n_samples_new + n_samples_take);
+            memcpy(pcmf32.data(), pcmf32_old.data() + pcmf32_old.size() - n_samples_take, n_samples_take*sizeof(float));
+            memcpy(pcmf32.data() + n_samples_take, pcmf32_new_local, n_samples_new*sizeof(float));
+            pcmf32_old.assign(pcmf32.begin(), pcmf32.end());
+            backlog.consume(n_samples_new);
 
             whisper_full_params wparams = whisper_full_default_params(params.beam_size > 1 ? WHISPER_SAMPLING_BEAM_SEARCH : WHISPER_SAMPLING_GREEDY);
             wparams.print_progress   = false;
@@ -413,18 +953,105 @@ int main(int argc, char ** argv) {
             wparams.language         = params.language.c_str();
             wparams.n_threads        = params.n_threads;
             wparams.beam_search.beam_size = params.beam_size;
-            wparams.audio_ctx        = params.audio_ctx;
+            wparams.audio_ctx        = params.audio_ctx == AUDIO_CTX_AUTO ? audio_ctx_bucket(pcmf32.size()) : params.audio_ctx;
             wparams.tdrz_enable      = params.tinydiarize;
             wparams.temperature_inc  = params.no_fallback ? 0.0f : wparams.temperature_inc;
             wparams.prompt_tokens    = params.no_context ? nullptr : prompt_tokens.data();
             wparams.prompt_n_tokens  = params.no_context ? 0       : prompt_tokens.size();
 
-            if (whisper_full(ctx, wparams, pcmf32.data(), pcmf32.size()) != 0) {
+            if (use_commit) {
+                wparams.token_timestamps = true;
+                wparams.prompt_tokens    = agreement.prompt().data();
+                wparams.prompt_n_tokens  = agreement.prompt().size();
+            }
+
+            const auto t_full_start = std::chrono::steady_clock::now();
+
+            int ret = 0;
+            if (mel) {
+                const auto t_start = std::chrono::steady_clock::now();
+                const int n_len = mel->compute(pcmf32.data(), pcmf32.size(), pos_new - n_samples_take, mel_data);
+                t_mel_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t_start).count();
+
+                // n_samples = 0 makes whisper_full use the spectrogram set here; duration_ms
+                // keeps it from decoding the 30 s of padding that whisper_set_mel counts as audio
+                wparams.duration_ms = (int) ((1000LL*pcmf32.size())/WHISPER_SAMPLE_RATE);
+
+                ret = whisper_set_mel(ctx, mel_data.data(), n_len, mel->n_mel());
+                if (ret == 0) {
+                    ret = whisper_full(ctx, wparams, nullptr, 0);
+                }
+            } else {
+                ret = whisper_full(ctx, wparams, pcmf32.data(), pcmf32.size());
+            }
+
+            if (params.audio_ctx == AUDIO_CTX_AUTO) {
+                const size_t b = std::find(ctx_buckets.begin(), ctx_buckets.end(), wparams.audio_ctx) - ctx_buckets.begin();
+                ctx_n_calls[b]++;
+                ctx_t_ms[b] += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t_full_start).count();
+            }
+
+            if (ret != 0) {
                 fprintf(stderr, "%s: failed to process audio\n", argv[0]);
                 is_running.store(false);
                 break;
             }
 
+            {
+                const double latency_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t_ready).count();
+                latency_ms_sum += latency_ms;
+                latency_ms_max  = std::max(latency_ms_max, latency_ms);
+                n_latency++;
+            }
+
+            if (use_commit) {
+                const int64_t t_window = pos_new - n_samples_take;
+                const whisper_token token_eot = whisper_token_eot(ctx);
+
+                std::vector<stream_token> hyp;
+                const int n_segments = whisper_full_n_segments(ctx);
+                for (int i = 0; i < n_segments; ++i) {
+                    const int n_tokens = whisper_full_n_tokens(ctx, i);
+                    for (int j = 0; j < n_tokens; ++j) {
+                        const whisper_token_data data = whisper_full_get_token_data(ctx, i, j);
+                        if (data.id >= token_eot) {
+                            continue;
+                        }
+                        stream_token t;
+                        t.id   = data.id;
+                        t.t0   = t_window + (data.t0*WHISPER_SAMPLE_RATE)/100;
+                        t.t1   = t_window + (data.t1*WHISPER_SAMPLE_RATE)/100;
+                        t.text = whisper_full_get_token_text(ctx, i, j);
+                        hyp.push_back(std::move(t));
+                    }
+                }
+                n_decoded += hyp.size();
+                n_steps++;
+
+                std::vector<stream_token> stable = agreement.update(hyp);
+
+                // no agreement within a whole --length window - commit anyway to keep the window bounded
+                if ((int) pcmf32.size() >= n_samples_len) {
+                    std::vector<stream_token> rest = agreement.flush();
+                    stable.insert(stable.end(), rest.begin(), rest.end());
+                }
+
+                commit_print(stable);
+                if (!stable.empty()) {
+                    const std::string & last = stable.back().text;
+                    if (!last.empty() && strchr(".?!", last.back())) {
+                        commit_end_line();
+                    }
+                }
+
+                // committed audio is never transcribed again
+                const int64_t n_cut = std::min<int64_t>(pcmf32.size(), std::max<int64_t>(0, agreement.committed_end() - t_window));
+                pcmf32_old.assign(pcmf32.begin() + n_cut, pcmf32.end());
+
+                fflush(stdout);
+                continue;
+            }
+
             if (!use_vad) {
                 printf("\33[2K\r");
                 printf("%s", std::string(100, ' ').c_str());
@@ -457,7 +1084,7 @@ int main(int argc, char ** argv) {
                     log_file << "[" << buf << "] " << sentence << std::endl;
                 }
                 sentence.clear();
-                pcmf32_old = std::vector<float>(pcmf32.end() - n_samples_keep, pcmf32.end());
+                pcmf32_old.assign(pcmf32.end() - std::min((int) pcmf32.size(), n_samples_keep), pcmf32.end());
                 if (!params.no_context) {
                     prompt_tokens.clear();
                     const int n_segments = whisper_full_n_segments(ctx);
@@ -475,10 +1102,36 @@ int main(int argc, char ** argv) {
 
     timestamped_print("[Start speaking]\n");
 
+    // everything allocated after this point is pipeline churn that the pool should have absorbed
+    const uint64_t n_allocs_warmup = pcm_n_allocs();
+
     auto last_voice_time = std::chrono::steady_clock::now();
     bool sent_silence = false;
     const int silence_timeout_ms = 2000;
 
+    // a file source ran out, what is left in the pipeline still gets transcribed
+    bool capture_done = false;
+
+    // a file would otherwise be partly skipped (or overrun the ring) while the model loads
+    if (use_file) {
+        audio->resume();
+    }
+    const auto t_capture_start = std::chrono::steady_clock::now();
+
+    // capture index of the next sample to read; audio captured while the model loaded is skipped,
+    // and marked read, a file replayed with backpressure would wait for it otherwise
+    // the VAD counts the samples it was fed, capture_offset maps that back to capture indices
+    audio->clear();
+    uint64_t capture_cursor = audio->n_captured();
+    int64_t  capture_offset = (int64_t) capture_cursor;
+    uint64_t n_capture_lost = 0;
+    uint64_t n_capture_torn = 0;
+
+    // the step being processed, read in place from the capture buffer
+    const float * pcm_new = nullptr;
+    size_t        n_new   = 0;
+    uint64_t      pos_new = 0;
+
     // main audio loop
     while (is_running.load()) {
         // handle Ctrl + C
@@ -488,60 +1141,200 @@ int main(int argc, char ** argv) {
         }
 
         while (is_running.load()) {
-            audio->get(params.step_ms, pcmf32_new);
+            // checked before reading, so the samples delivered last are part of this read
+            const bool eof = audio->eof();
 
-            /*if ((int)pcmf32_new.size() > 2 * n_samples_step) {
-                fprintf(stderr, "\n\n%s: WARNING: cannot process audio fast enough, dropping audio ...\n\n", __func__);
-                audio->clear();
-                continue;
-            }*/
-            if ((int)pcmf32_new.size() > 2 * n_samples_step) {
+            const uint64_t n_pending = audio->n_captured() - capture_cursor;
+            capture_done = eof && n_pending <= (uint64_t) n_samples_step;
+            if (n_pending > 2*(uint64_t) n_samples_step) {
                 fprintf(stderr,
-                    "\n\n%s: WARNING: capture backlog size = %zu samples (not dropping)\n\n",
-                    __func__, pcmf32_new.size());// 더 이상 드롭하지 않고, backlog 처리에 맡김
+                    "\n\n%s: WARNING: capture backlog size = %llu samples (not dropping)\n\n",
+                    __func__, (unsigned long long) n_pending);// 더 이상 드롭하지 않고, backlog 처리에 맡김
             }
 
-            if ((int) pcmf32_new.size() >= n_samples_step) {
-                audio->clear();
+            if (n_pending >= (uint64_t) n_samples_step || capture_done) {
+                // one step at a time, the rest stays in the ring for the next round
+                const uint64_t expected = capture_cursor;
+                n_new = audio->view_since(capture_cursor, n_samples_step, pcm_new, pos_new);
+
+                // samples overwritten before they were read leave a gap in the capture positions
+                if (pos_new > expected) {
+                    n_capture_lost += pos_new - expected;
+                    capture_offset += (int64_t) (pos_new - expected);
+                }
                 break;
             }
 
-            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            // hand over anything coalesced while the consumer was behind
+            audio_queue.flush();
+
+            // sleep until the capture callback has delivered a full step
+            audio->wait(params.step_ms, 100);
         }
 
         if (!is_running.load()) {
             break;
         }
 
-        // Skip sending audio to the model if no speech is detected
-        bool is_speech = vad_detect_speech(pcmf32_new, WHISPER_SAMPLE_RATE);
-        if (!is_speech) {
+        // Skip sending audio to the model outside of speech regions
+        vad_events.clear();
+        vad_speech.clear();
+        vad.feed(pcm_new, n_new, vad_events, vad_speech);
+
+        // the VAD copied what it forwards, after this the step may be overwritten
+        // a torn step is dropped: the region so far goes out, one still open restarts after it
+        // the VAD clock already counts the step, so the chunk positions need no offset
+        const bool torn = !audio->intact(pos_new);
+        if (torn) {
+            n_capture_torn++;
+            n_capture_lost += n_new;
+        }
+
+        if (vad.in_speech() || !vad_events.empty()) {
+            last_voice_time = std::chrono::steady_clock::now();
+            sent_silence = false;
+        }
+
+        // split the forwarded audio at region boundaries, regions are cut further at pauses
+        if (torn) {
+            if (vad.in_speech()) {
+                chunker.begin(vad.position());
+            } else {
+                chunker.flush();
+            }
+        } else {
+            size_t i_speech = 0;
+            for (const auto & e : vad_events) {
+                chunker.push(vad_speech.data() + i_speech, e.i_speech - i_speech);
+                i_speech = e.i_speech;
+                if (e.type == vad_event::speech_start) {
+                    chunker.begin(e.pos);
+                } else {
+                    chunker.flush();
+                }
+            }
+            chunker.push(vad_speech.data() + i_speech, vad_speech.size() - i_speech);
+        }
+
+        if (capture_done) {
+            chunker.flush();
+        }
+
+        while (chunker.ready()) {
+            pcm_chunk chunk;
+            chunk.pcm = audio_pool.acquire();
+            chunker.pop(chunk.pcm, chunk.pos);
+            chunk.pos    += capture_offset;
+            chunk.t_ready = std::chrono::steady_clock::now();
+
+            pcm_chunk spill;
+            if (audio_queue.push(std::move(chunk), spill)) {
+                audio_pool.reclaim(std::move(spill.pcm));
+            }
+        }
+
+        if (vad_speech.empty()) {
             auto now = std::chrono::steady_clock::now();
             if (!sent_silence &&
                 std::chrono::duration_cast<std::chrono::milliseconds>(now - last_voice_time).count() > silence_timeout_ms) {
-                while (!audio_queue.push(std::vector<float>()) && is_running.load()) {
-                    std::vector<float> drop;
-                    audio_queue.pop(drop);
+                pcm_chunk marker;
+                marker.pcm = audio_pool.acquire();
+
+                pcm_chunk spill;
+                if (audio_queue.push(std::move(marker), spill)) {
+                    audio_pool.reclaim(std::move(spill.pcm));
                 }
                 sent_silence = true;
             }
-            continue;
         }
 
-        last_voice_time = std::chrono::steady_clock::now();
-        sent_silence = false;
-
-        while (!audio_queue.push(std::move(pcmf32_new)) && is_running.load()) {
-            std::vector<float> drop;
-            audio_queue.pop(drop);
+        if (capture_done) {
+            // the coalesced tail is the end of the stream, it waits for room rather than being dropped
+            while (!audio_queue.flush_wait(100) && is_running.load()) {
+            }
+            break;
         }
     }
 
-    is_running.store(false);
+    if (capture_done) {
+        draining.store(true);
+    } else {
+        is_running.store(false);
+    }
+    audio_queue.notify();
     inference_thread.join();
+    is_running.store(false);
+
+    const double t_wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_capture_start).count();
 
     audio->pause();
 
+    fprintf(stderr, "%s: vad (%s): %llu speech regions, %.1f of %.1f sec forwarded to inference\n",
+            __func__, vad.backend_name(), (unsigned long long) vad.n_regions(),
+            float(vad.n_forwarded())/WHISPER_SAMPLE_RATE, float(vad.position())/WHISPER_SAMPLE_RATE);
+
+    fprintf(stderr, "%s: chunker: %llu chunks, %llu cut without a pause\n",
+            __func__, (unsigned long long) chunker.n_chunks(), (unsigned long long) chunker.n_forced());
+
+    fprintf(stderr, "%s: pcm buffer allocations while streaming = %llu\n", __func__, (unsigned long long) (pcm_n_allocs() - n_allocs_warmup));
+
+    {
+        const queue_stats qs = audio_queue.stats();
+        fprintf(stderr, "%s: audio queue (%s): pushed = %llu, dropped oldest = %llu, dropped newest = %llu, blocked = %llu (timed out = %llu), coalesced = %llu\n",
+                __func__, queue_overflow_name(audio_queue.policy()),
+                (unsigned long long) qs.n_pushed,
+                (unsigned long long) qs.n_dropped_old,
+                (unsigned long long) qs.n_dropped_new,
+                (unsigned long long) qs.n_block_waits,
+                (unsigned long long) qs.n_block_drops,
+                (unsigned long long) qs.n_coalesced);
+    }
+
+    if (!params.use_openai) {
+        fprintf(stderr, "%s: catch-up: %llu windows, max lag = %.1f sec, skipped = %.1f sec\n",
+                __func__, (unsigned long long) backlog.n_windows(),
+                float(backlog.n_max_lag())/WHISPER_SAMPLE_RATE, float(backlog.n_skipped())/WHISPER_SAMPLE_RATE);
+    }
+
+    if (use_commit && n_steps > 0) {
+        fprintf(stderr, "%s: commit mode: %llu tokens decoded in %llu steps (%.1f per step), %llu committed\n",
+                __func__, (unsigned long long) n_decoded, (unsigned long long) n_steps,
+                double(n_decoded)/n_steps, (unsigned long long) agreement.n_committed());
+    }
+
+    if (params.audio_ctx == AUDIO_CTX_AUTO) {
+        for (size_t b = 0; b < ctx_buckets.size(); ++b) {
+            if (ctx_n_calls[b] > 0) {
+                fprintf(stderr, "%s: audio_ctx %4d: %d calls, %.2f ms avg\n",
+                        __func__, ctx_buckets[b], ctx_n_calls[b], ctx_t_ms[b]/ctx_n_calls[b]);
+            }
+        }
+    }
+
+    if (mel) {
+        fprintf(stderr, "%s: mel cache: %llu frames computed, %llu reused, %.2f ms total\n",
+                __func__, (unsigned long long) mel->n_computed(), (unsigned long long) mel->n_reused(), t_mel_ms);
+    }
+
+    if (n_latency > 0) {
+        fprintf(stderr, "%s: latency from queueing to text: avg %.0f ms, max %.0f ms over %llu windows\n",
+                __func__, latency_ms_sum/n_latency, latency_ms_max, (unsigned long long) n_latency);
+    }
+
+    if (t_wall > 0.0 && vad.position() > 0) {
+        const double t_audio = double(vad.position())/WHISPER_SAMPLE_RATE;
+        fprintf(stderr, "%s: %.1f sec of audio in %.1f sec, RTF = %.3f\n", __func__, t_audio, t_wall, t_wall/t_audio);
+    }
+
+    if (n_capture_torn > 0) {
+        fprintf(stderr, "%s: WARNING: %llu steps were overwritten while the VAD read them\n", __func__, (unsigned long long) n_capture_torn);
+    }
+
+    if (audio->n_overruns() > 0) {
+        fprintf(stderr, "%s: WARNING: capture ring overran %llu times, %.1f sec of audio was lost\n",
+                __func__, (unsigned long long) audio->n_overruns(), float(n_capture_lost)/WHISPER_SAMPLE_RATE);
+    }
+
     if (ctx) {
         whisper_print_timings(ctx);
         whisper_free(ctx);
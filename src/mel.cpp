@@ -0,0 +1,237 @@
+#include "mel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+
+// slaney mel scale: linear below 1 kHz, logarithmic above
+static double hz_to_mel(double hz) {
+    const double f_sp      = 200.0/3.0;
+    const double min_log_hz  = 1000.0;
+    const double min_log_mel = min_log_hz/f_sp;
+    const double logstep     = log(6.4)/27.0;
+
+    return hz < min_log_hz ? hz/f_sp : min_log_mel + log(hz/min_log_hz)/logstep;
+}
+
+static double mel_to_hz(double mel) {
+    const double f_sp      = 200.0/3.0;
+    const double min_log_hz  = 1000.0;
+    const double min_log_mel = min_log_hz/f_sp;
+    const double logstep     = log(6.4)/27.0;
+
+    return mel < min_log_mel ? f_sp*mel : min_log_hz*exp(logstep*(mel - min_log_mel));
+}
+
+mel_filterbank mel_filterbank_slaney(int n_mel, int n_fft, int sample_rate) {
+    mel_filterbank fb;
+    fb.n_mel  = n_mel;
+    fb.n_bins = n_fft/2 + 1;
+    fb.data .assign(n_mel*fb.n_bins, 0.0f);
+    fb.begin.assign(n_mel, fb.n_bins);
+    fb.end  .assign(n_mel, 0);
+
+    // band edges, equally spaced on the mel scale between 0 and nyquist
+    std::vector<double> mel_f(n_mel + 2);
+    const double mel_max = hz_to_mel(0.5*sample_rate);
+    for (int i = 0; i < n_mel + 2; ++i) {
+        mel_f[i] = mel_to_hz(mel_max*i/(n_mel + 1));
+    }
+
+    for (int j = 0; j < n_mel; ++j) {
+        const double lower  = mel_f[j];
+        const double center = mel_f[j + 1];
+        const double upper  = mel_f[j + 2];
+        const double enorm  = 2.0/(upper - lower);
+
+        for (int k = 0; k < fb.n_bins; ++k) {
+            const double hz = (double) k*sample_rate/n_fft;
+            const double w  = std::max(0.0, std::min((hz - lower)/(center - lower), (upper - hz)/(upper - center)));
+            if (w > 0.0) {
+                fb.data[j*fb.n_bins + k] = (float) (w*enorm);
+                fb.begin[j] = std::min(fb.begin[j], k);
+                fb.end[j]   = std::max(fb.end[j],   k + 1);
+            }
+        }
+    }
+
+    return fb;
+}
+
+int mel_align_take(int64_t pos, int n_take) {
+    const int64_t start = pos - n_take;
+    const int     skip  = (int) ((WHISPER_MEL_HOP - (start % WHISPER_MEL_HOP + WHISPER_MEL_HOP) % WHISPER_MEL_HOP) % WHISPER_MEL_HOP);
+
+    return std::max(0, n_take - skip);
+}
+
+mel_cache::mel_cache(int n_mel, int sample_rate, int n_max_frames)
+    : m_filters(mel_filterbank_slaney(n_mel, WHISPER_MEL_N_FFT, sample_rate)),
+      m_spectrum(WHISPER_MEL_N_FFT),
+      m_n_pad_end(30*sample_rate),
+      m_n_max_frames(n_max_frames) {
+    m_power   .resize(m_spectrum.n_bins());
+    m_edge    .resize(WHISPER_MEL_N_FFT);
+    m_col     .resize(n_mel);
+
+    m_frames.assign((size_t) n_max_frames*n_mel, 0.0f);
+    m_tags  .assign(n_max_frames, -1);
+}
+
+void mel_cache::frame(const float * x, float * dst) {
+    m_spectrum.compute(x, m_power.data());
+
+    for (int j = 0; j < m_filters.n_mel; ++j) {
+        const float * w = m_filters.data.data() + j*m_filters.n_bins;
+
+        double sum = 0.0;
+        for (int k = m_filters.begin[j]; k < m_filters.end[j]; ++k) {
+            sum += m_power[k]*w[k];
+        }
+        dst[j] = (float) log10(std::max(sum, 1e-10));
+    }
+
+    m_n_computed++;
+}
+
+int mel_cache::compute(const float * samples, int n, int64_t pos, std::vector<float> & out) {
+    const int n_mel = m_filters.n_mel;
+    const int half  = WHISPER_MEL_N_FFT/2;
+    const int n_len = (n + m_n_pad_end)/WHISPER_MEL_HOP;
+
+    const bool    aligned = pos >= 0 && pos % WHISPER_MEL_HOP == 0;
+    const int64_t f0      = pos/WHISPER_MEL_HOP;
+
+    out.resize((size_t) n_mel*n_len);
+
+    float * col = m_col.data();
+    float mmax = -1e20f;
+
+    for (int i = 0; i < n_len; ++i) {
+        const int c = i*WHISPER_MEL_HOP;
+        const float * src = col;
+
+        if (c - half >= n) {
+            // only zero padding left
+            std::fill(col, col + n_mel, -10.0f);
+        } else if (c - half >= 0 && c + half <= n) {
+            if (aligned) {
+                const int64_t f    = f0 + i;
+                const int     slot = (int) (f % m_n_max_frames);
+                float * cached = m_frames.data() + (size_t) slot*n_mel;
+                if (m_tags[slot] == f) {
+                    m_n_reused++;
+                } else {
+                    frame(samples + c - half, cached);
+                    m_tags[slot] = f;
+                }
+                src = cached;
+            } else {
+                frame(samples + c - half, col);
+            }
+        } else {
+            // frame touches the reflect padding at the start or the zero padding at the end
+            for (int t = 0; t < WHISPER_MEL_N_FFT; ++t) {
+                const int idx = c - half + t;
+                if (idx < 0) {
+                    m_edge[t] = -idx < n ? samples[-idx] : 0.0f;
+                } else {
+                    m_edge[t] = idx < n ? samples[idx] : 0.0f;
+                }
+            }
+            frame(m_edge.data(), col);
+        }
+
+        for (int j = 0; j < n_mel; ++j) {
+            out[(size_t) j*n_len + i] = src[j];
+            mmax = std::max(mmax, src[j]);
+        }
+    }
+
+    mmax -= 8.0f;
+    for (float & v : out) {
+        v = (std::max(v, mmax) + 4.0f)/4.0f;
+    }
+
+    return n_len;
+}
+
+void mel_cache_bench(int sample_rate) {
+    const double t_audio   = 30.0;
+    const int    keep_ms   = 200;
+    const int    length_ms = 6000;
+    const int    steps_ms[] = { 500, 1000, 2000, 5000 };
+    const int    n_mels[]   = { 80, 128 };
+
+    std::vector<float> audio((size_t) (t_audio*sample_rate));
+    {
+        std::mt19937 rng(1);
+        std::normal_distribution<float> noise(0.0f, 0.1f);
+        for (auto & v : audio) {
+            v = noise(rng);
+        }
+    }
+
+    printf("\n%s: %.0f sec, %d ms kept + %d ms window, steps of uneven length as cut by the chunker\n\n", __func__, t_audio, keep_ms, length_ms);
+    printf("%6s %8s %8s %14s %14s %10s %14s %10s\n", "n_mel", "step ms", "steps", "full ms/step", "cache ms/step", "speedup", "frames/step", "max diff");
+
+    std::vector<float> out_full;
+    std::vector<float> out_cache;
+    for (int n_mel : n_mels) {
+        for (int step_ms : steps_ms) {
+            const int n_step = (int) ((int64_t) sample_rate*step_ms/1000);
+            const int n_keep = (int) ((int64_t) sample_rate*keep_ms/1000);
+            const int n_len  = (int) ((int64_t) sample_rate*length_ms/1000);
+
+            // the uncached reference recomputes every frame, pos -1 disables the reuse
+            mel_cache full (n_mel, sample_rate, 30*sample_rate/WHISPER_MEL_HOP + 100);
+            mel_cache cache(n_mel, sample_rate, 30*sample_rate/WHISPER_MEL_HOP + 100);
+
+            double t_full  = 0.0;
+            double t_cache = 0.0;
+            double diff    = 0.0;
+            int    n_steps = 0;
+
+            // the window of the previous step ends at pos, as pcmf32_old does in the stream loop
+            int64_t pos   = 0;
+            int     n_old = 0;
+            while (true) {
+                // chunks end wherever the pauses are, a few hops either way of the step
+                const int n_new = n_step + (int) ((n_steps*1237) % (4*WHISPER_MEL_HOP)) - 2*WHISPER_MEL_HOP + 1;
+                if (pos + n_new > (int64_t) audio.size()) {
+                    break;
+                }
+
+                int n_take = std::min(n_old, std::max(0, n_keep + n_len - n_new));
+                n_take = mel_align_take(pos, n_take);
+
+                const int64_t begin = pos - n_take;
+                const float * x     = audio.data() + begin;
+                const int     n     = n_take + n_new;
+
+                auto t0 = std::chrono::steady_clock::now();
+                full.compute(x, n, -1, out_full);
+                auto t1 = std::chrono::steady_clock::now();
+                cache.compute(x, n, begin, out_cache);
+                auto t2 = std::chrono::steady_clock::now();
+
+                t_full  += std::chrono::duration<double, std::milli>(t1 - t0).count();
+                t_cache += std::chrono::duration<double, std::milli>(t2 - t1).count();
+                for (size_t i = 0; i < out_full.size(); ++i) {
+                    diff = std::max(diff, (double) fabsf(out_full[i] - out_cache[i]));
+                }
+                n_steps++;
+
+                pos  += n_new;
+                n_old = n;
+            }
+
+            printf("%6d %8d %8d %14.2f %14.2f %10.1f %14.1f %10.1e\n", n_mel, step_ms, n_steps,
+                    t_full/n_steps, t_cache/n_steps, t_full/std::max(t_cache, 1e-9),
+                    double(cache.n_computed())/n_steps, diff);
+        }
+    }
+}
@@ -70,9 +70,9 @@ static std::string base64_encode(const unsigned char *data, size_t len) {
     return out;
 }
 
-static std::string pcmf32_to_base64(const std::vector<float> &audio) {
-    std::vector<int16_t> pcm16(audio.size());
-    for (size_t i = 0; i < audio.size(); ++i) {
+static std::string pcmf32_to_base64(const float *audio, size_t n_samples) {
+    std::vector<int16_t> pcm16(n_samples);
+    for (size_t i = 0; i < n_samples; ++i) {
         float v = std::max(-1.0f, std::min(1.0f, audio[i]));
         pcm16[i] = (int16_t) (v * 32767.0f);
     }
@@ -196,9 +196,9 @@ bool OpenAIRealtimeClient::connect() {
     return true;
 }
 
-bool OpenAIRealtimeClient::send_audio(const std::vector<float> &audio) {
+bool OpenAIRealtimeClient::send_audio(const float *audio, size_t n_samples) {
     if (!m_curl) return false;
-    std::string b64 = pcmf32_to_base64(audio);
+    std::string b64 = pcmf32_to_base64(audio, n_samples);
     std::string msg = "{\"type\":\"audio_data\",\"data\":\"" + b64 + "\"}";
     size_t sent = 0;
     CURLcode res = curl_ws_send(m_curl, msg.c_str(), msg.size(), &sent, 0, CURLWS_TEXT);
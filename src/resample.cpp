@@ -0,0 +1,313 @@
+#define _USE_MATH_DEFINES // for M_PI
+#include "resample.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define RESAMPLE_X86
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__aarch64__) || defined(_M_ARM64)
+#define RESAMPLE_NEON
+#include <arm_neon.h>
+#endif
+
+#define RESAMPLE_CUTOFF      0.45 // of the lower rate
+#define RESAMPLE_KAISER_BETA 9.0  // around 90 dB stopband
+
+// device frames converted per pass in the capture callback
+#define CONVERT_BLOCK 1024
+
+static int gcd(int a, int b) {
+    while (b != 0) {
+        const int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// modified Bessel function of the first kind, order 0
+static double bessel_i0(double x) {
+    double sum  = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 50; ++k) {
+        term *= (x/(2.0*k))*(x/(2.0*k));
+        sum  += term;
+        if (term < 1e-12*sum) {
+            break;
+        }
+    }
+    return sum;
+}
+
+// n is a multiple of 8
+static float resample_dot(const float * x, const float * h, int n) {
+#if defined(RESAMPLE_X86)
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    for (int i = 0; i < n; i += 8) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(x + i),     _mm_loadu_ps(h + i)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(x + i + 4), _mm_loadu_ps(h + i + 4)));
+    }
+    acc0 = _mm_add_ps(acc0, acc1);
+    acc0 = _mm_add_ps(acc0, _mm_movehl_ps(acc0, acc0));
+    acc0 = _mm_add_ss(acc0, _mm_shuffle_ps(acc0, acc0, 1));
+    return _mm_cvtss_f32(acc0);
+#elif defined(RESAMPLE_NEON)
+    float32x4_t acc0 = vdupq_n_f32(0.0f);
+    float32x4_t acc1 = vdupq_n_f32(0.0f);
+    for (int i = 0; i < n; i += 8) {
+        acc0 = vmlaq_f32(acc0, vld1q_f32(x + i),     vld1q_f32(h + i));
+        acc1 = vmlaq_f32(acc1, vld1q_f32(x + i + 4), vld1q_f32(h + i + 4));
+    }
+    return vaddvq_f32(vaddq_f32(acc0, acc1));
+#else
+    float sum = 0.0f;
+    for (int i = 0; i < n; ++i) {
+        sum += x[i]*h[i];
+    }
+    return sum;
+#endif
+}
+
+resampler::resampler(int rate_in, int rate_out, int n_zeros) {
+    const int g = gcd(rate_in, rate_out);
+    m_l = rate_out/g;
+    m_m = rate_in/g;
+
+    if (passthrough()) {
+        m_half   = 0;
+        m_n_taps = 0;
+        m_t      = 0;
+        return;
+    }
+
+    // cutoff in cycles per input sample, the sinc has a zero crossing every 1/(2*fc) samples
+    const double fc = RESAMPLE_CUTOFF*std::min(1.0, double(m_l)/m_m);
+
+    m_half   = (int) ceil(n_zeros/(2.0*fc));
+    m_n_taps = (2*m_half + 7) & ~7;
+
+    // phase p computes the output at input position i0 + p/L from x[i0 - half + 1 + k]
+    m_taps.assign((size_t) m_l*m_n_taps, 0.0f);
+    const double i0_beta = bessel_i0(RESAMPLE_KAISER_BETA);
+    for (int p = 0; p < m_l; ++p) {
+        float * taps = m_taps.data() + (size_t) p*m_n_taps;
+
+        double sum = 0.0;
+        for (int k = 0; k < 2*m_half; ++k) {
+            const double d = double(p)/m_l + m_half - 1 - k;
+            const double r = d/m_half;
+            if (fabs(r) >= 1.0) {
+                continue;
+            }
+
+            const double a    = 2.0*M_PI*fc*d;
+            const double sinc = d == 0.0 ? 1.0 : sin(a)/a;
+            const double w    = bessel_i0(RESAMPLE_KAISER_BETA*sqrt(1.0 - r*r))/i0_beta;
+
+            taps[k] = (float) (2.0*fc*sinc*w);
+            sum    += taps[k];
+        }
+
+        // unity gain at DC for every phase
+        for (int k = 0; k < 2*m_half; ++k) {
+            taps[k] = (float) (taps[k]/sum);
+        }
+    }
+
+    reset();
+}
+
+void resampler::reset() {
+    // half - 1 samples of silence in front, so the first output lines up with input sample 0
+    m_buf.assign(std::max(m_half - 1, 0), 0.0f);
+    m_buf.reserve(m_n_taps + CONVERT_BLOCK);
+    m_t = (uint64_t) m_buf.size()*m_l;
+}
+
+size_t resampler::process(const float * in, size_t n, float * out) {
+    if (passthrough()) {
+        memcpy(out, in, n*sizeof(float));
+        return n;
+    }
+
+    m_buf.insert(m_buf.end(), in, in + n);
+
+    // the taps of the last output read up to i0 + n_taps - half, the padding is zero
+    size_t n_out = 0;
+    while (true) {
+        const uint64_t i0 = m_t/m_l;
+        if (i0 + m_n_taps - m_half + 1 > m_buf.size()) {
+            break;
+        }
+
+        const int p = (int) (m_t - i0*m_l);
+        out[n_out++] = resample_dot(m_buf.data() + i0 - m_half + 1, m_taps.data() + (size_t) p*m_n_taps, m_n_taps);
+
+        m_t += m_m;
+    }
+
+    // keep what the next output still needs
+    const size_t n_drop = (size_t) (m_t/m_l) - m_half + 1;
+    m_buf.erase(m_buf.begin(), m_buf.begin() + n_drop);
+    m_t -= (uint64_t) n_drop*m_l;
+
+    return n_out;
+}
+
+void capture_convert::init(int rate_in, int n_channels, int rate_out) {
+    m_rate_in    = rate_in;
+    m_rate_out   = rate_out;
+    m_n_channels = std::max(n_channels, 1);
+
+    m_resampler = resampler(rate_in, rate_out);
+    m_filter    = capture_filter((float) rate_out);
+
+    m_mono.resize(CONVERT_BLOCK);
+    m_out .resize(m_resampler.max_out(CONVERT_BLOCK));
+}
+
+void capture_convert::set_filter(float freq_hp, float pre_emphasis) {
+    m_filter = capture_filter((float) m_rate_out, freq_hp, pre_emphasis);
+}
+
+void capture_convert::process(const float * input, size_t n_frames, audio_ring & ring) {
+    if (ring.window() == 0) {
+        return;
+    }
+
+    if (m_resampler.passthrough()) {
+        // only the most recent window can be read back, but the filter state wants every frame
+        while (n_frames > 0) {
+            const size_t n = std::min(n_frames, ring.window());
+
+            float * p0;
+            float * p1;
+            size_t  n0;
+            size_t  n1;
+            ring.reserve(n, p0, n0, p1, n1);
+
+            capture_downmix(input, n0, m_n_channels, p0);
+            capture_downmix(input + n0*m_n_channels, n1, m_n_channels, p1);
+            m_filter.process(p0, n0);
+            m_filter.process(p1, n1);
+
+            ring.commit(n);
+
+            input    += n*m_n_channels;
+            n_frames -= n;
+        }
+        return;
+    }
+
+    while (n_frames > 0) {
+        const size_t n = std::min<size_t>(n_frames, CONVERT_BLOCK);
+
+        capture_downmix(input, n, m_n_channels, m_mono.data());
+        const size_t n_out = m_resampler.process(m_mono.data(), n, m_out.data());
+        m_filter.process(m_out.data(), n_out);
+        ring.write(m_out.data(), n_out);
+
+        input    += n*m_n_channels;
+        n_frames -= n;
+    }
+}
+
+void resampler_bench(int rate_out) {
+    const int    rates_in[] = { 44100, 48000, 96000 };
+    const double t_audio    = 10.0;
+
+    // in band: a few tones well inside the passband; out of band: one that must not fold back
+    const double f_in[]  = { 440.0, 1250.5, 3100.3 };
+    const double f_out   = 0.7*rate_out;
+
+    printf("\n%s: %.0f sec per stream to %d Hz, 10 ms blocks\n\n", __func__, t_audio, rate_out);
+    printf("%8s %10s %8s %10s %12s %10s\n", "rate in", "method", "taps", "SNR dB", "alias dB", "% core");
+
+    for (int rate_in : rates_in) {
+        const size_t n_in    = (size_t) (t_audio*rate_in);
+        const size_t n_block = rate_in/100;
+
+        std::vector<float> tones(n_in);
+        std::vector<float> alias(n_in);
+        for (size_t i = 0; i < n_in; ++i) {
+            const double t = double(i)/rate_in;
+            double v = 0.0;
+            for (double f : f_in) {
+                v += 0.3*sin(2.0*M_PI*f*t);
+            }
+            tones[i] = (float) v;
+            alias[i] = (float) (0.5*sin(2.0*M_PI*f_out*t));
+        }
+
+        // what an ideal converter outputs for the in-band tones, the out-of-band one is removed
+        const size_t n_ref = (size_t) (double(n_in)*rate_out/rate_in);
+        std::vector<float> ref(n_ref);
+        for (size_t j = 0; j < n_ref; ++j) {
+            const double t = double(j)/rate_out;
+            double v = 0.0;
+            for (double f : f_in) {
+                v += 0.3*sin(2.0*M_PI*f*t);
+            }
+            ref[j] = (float) v;
+        }
+
+        std::vector<float> out(n_ref + n_block);
+
+        // two methods: 0 = linear interpolation, as a cheap baseline, 1 = resampler
+        for (int method = 0; method < 2; ++method) {
+            resampler rs(rate_in, rate_out);
+
+            auto run = [&](const std::vector<float> & x, std::vector<float> & y) {
+                size_t n_out = 0;
+                if (method == 0) {
+                    const double step = double(rate_in)/rate_out;
+                    for (size_t j = 0; j < y.size(); ++j) {
+                        const double pos = j*step;
+                        const size_t i   = (size_t) pos;
+                        if (i + 1 >= x.size()) {
+                            break;
+                        }
+                        const float f = (float) (pos - i);
+                        y[n_out++] = x[i] + f*(x[i + 1] - x[i]);
+                    }
+                } else {
+                    rs.reset();
+                    for (size_t off = 0; off < x.size(); off += n_block) {
+                        n_out += rs.process(x.data() + off, std::min(n_block, x.size() - off), y.data() + n_out);
+                    }
+                }
+                return n_out;
+            };
+
+            const auto t_start = std::chrono::steady_clock::now();
+            const size_t n_out = run(tones, out);
+            const double t_cpu = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+
+            // skip the edges, where the filter sees the zero padding
+            const size_t skip = 100 + rs.n_taps();
+            double e_sig = 0.0;
+            double e_err = 0.0;
+            for (size_t j = skip; j + skip < std::min(n_out, n_ref); ++j) {
+                e_sig += double(ref[j])*ref[j];
+                e_err += double(out[j] - ref[j])*(out[j] - ref[j]);
+            }
+
+            const size_t n_alias = run(alias, out);
+            double e_alias = 0.0;
+            double e_tone  = 0.0;
+            for (size_t j = skip; j + skip < n_alias; ++j) {
+                e_alias += double(out[j])*out[j];
+                e_tone  += 0.125;
+            }
+
+            printf("%8d %10s %8d %10.1f %12.1f %10.3f\n", rate_in, method == 0 ? "linear" : "polyphase", method == 0 ? 2 : rs.n_taps(),
+                    10.0*log10(e_sig/std::max(e_err, 1e-30)), 10.0*log10(std::max(e_alias, 1e-30)/e_tone), 100.0*t_cpu/t_audio);
+        }
+    }
+}
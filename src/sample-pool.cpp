@@ -0,0 +1,194 @@
+#include "sample-pool.h"
+
+#include "bounded-queue.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+static std::atomic<uint64_t> g_pcm_n_allocs{0};
+
+void * pcm_aligned_alloc(size_t n_bytes, size_t alignment) {
+    g_pcm_n_allocs.fetch_add(1, std::memory_order_relaxed);
+
+#ifdef _WIN32
+    return _aligned_malloc(n_bytes, alignment);
+#else
+    void * ptr = nullptr;
+    if (posix_memalign(&ptr, alignment, n_bytes) != 0) {
+        return nullptr;
+    }
+    return ptr;
+#endif
+}
+
+void pcm_aligned_free(void * ptr) {
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+uint64_t pcm_n_allocs() {
+    return g_pcm_n_allocs.load(std::memory_order_relaxed);
+}
+
+pcm_pool::pcm_pool(size_t n_blocks, size_t n_samples)
+    : m_free(n_blocks), m_n_samples(n_samples) {
+    for (size_t i = 0; i < n_blocks; ++i) {
+        pcm_block block;
+        block.reserve(m_n_samples);
+        m_free.push(std::move(block));
+    }
+}
+
+pcm_block pcm_pool::acquire() {
+    pcm_block block;
+    if (m_spare.capacity() > 0) {
+        block = std::move(m_spare);
+        m_spare = pcm_block();
+    } else if (!m_free.pop(block)) {
+        block.reserve(m_n_samples);
+    }
+    return block;
+}
+
+void pcm_pool::reclaim(pcm_block && block) {
+    block.clear();
+    m_spare = std::move(block);
+}
+
+void pcm_pool::release(pcm_block && block) {
+    block.clear();
+    m_free.push(std::move(block));
+}
+
+bool pcm_chunk_merge(pcm_chunk & dst, const pcm_chunk & src, size_t n_max) {
+    if (dst.pos < 0 || src.pos != dst.pos + (int64_t) dst.pcm.size() || dst.pcm.size() + src.pcm.size() > n_max) {
+        return false;
+    }
+    dst.pcm.insert(dst.pcm.end(), src.pcm.begin(), src.pcm.end());
+    dst.t_ready = src.t_ready;
+    return true;
+}
+
+// every sample holds its capture index, so the consumer can tell where it came from
+static float pcm_stress_sample(int64_t pos) {
+    return (float) (pos & 0xffff);
+}
+
+void pcm_queue_stress(int sample_rate) {
+    const size_t n_queue  = 8;
+    const size_t n_step   = sample_rate/10;
+    const size_t n_block  = 4*n_step;
+    const int    n_chunks = 1000;
+    const int    n_warmup = 100;
+
+    // the producer queues a step every 0.5 ms, the consumer spends 4 ms on each item
+    const auto t_produce = std::chrono::microseconds(500);
+    const auto t_consume = std::chrono::microseconds(4000);
+
+    printf("\n%s: %d chunks of %zu samples, a marker every 50 and a gap every 37, queue of %zu, blocks of %zu samples\n\n",
+            __func__, n_chunks, n_step, n_queue, n_block);
+    printf("%12s %8s %8s %8s %8s %10s %10s %8s %8s %10s\n",
+            "policy", "queued", "markers", "dropped", "merged", "largest", "misplaced", "allocs", "% audio", "push max us");
+
+    for (queue_overflow policy : { queue_overflow::drop_oldest, queue_overflow::drop_newest, queue_overflow::block, queue_overflow::coalesce }) {
+        bounded_queue<pcm_chunk> queue(n_queue, policy, 100,
+            [n_block](pcm_chunk & dst, pcm_chunk & src) { return pcm_chunk_merge(dst, src, n_block); });
+        pcm_pool pool(n_queue + 2, n_block);
+
+        std::atomic<bool>     done(false);
+        std::atomic<uint64_t> n_allocs_warm(0);
+
+        uint64_t n_items     = 0;
+        uint64_t n_markers   = 0;
+        uint64_t n_samples   = 0;
+        uint64_t n_misplaced = 0;
+        size_t   n_largest   = 0;
+
+        std::thread consumer([&]() {
+            pcm_chunk chunk;
+            while (true) {
+                if (!queue.pop_wait(chunk, 100)) {
+                    if (done.load() && queue.empty()) {
+                        break;
+                    }
+                    continue;
+                }
+                n_items++;
+                if (chunk.pos < 0) {
+                    n_markers++;
+                }
+                for (size_t i = 0; i < chunk.pcm.size(); ++i) {
+                    if (chunk.pcm[i] != pcm_stress_sample(chunk.pos + (int64_t) i)) {
+                        n_misplaced++;
+                        break;
+                    }
+                }
+                n_samples += chunk.pcm.size();
+                n_largest  = std::max(n_largest, chunk.pcm.size());
+                pool.release(std::move(chunk.pcm));
+                std::this_thread::sleep_for(t_consume);
+            }
+        });
+
+        int64_t  pos        = 0;
+        uint64_t n_produced = 0;
+        double   t_push_max = 0.0;
+        for (int i = 0; i < n_chunks; ++i) {
+            if (i == n_warmup) {
+                n_allocs_warm.store(pcm_n_allocs());
+            }
+
+            pcm_chunk chunk;
+            chunk.pcm = pool.acquire();
+            if (i % 50 == 49) {
+                // a silence marker, no audio
+            } else {
+                if (i % 37 == 36) {
+                    pos += (int64_t) n_step; // samples lost before they were queued
+                }
+                chunk.pos = pos;
+                chunk.pcm.resize(n_step);
+                for (size_t j = 0; j < n_step; ++j) {
+                    chunk.pcm[j] = pcm_stress_sample(pos + (int64_t) j);
+                }
+                pos        += (int64_t) n_step;
+                n_produced += n_step;
+            }
+            chunk.t_ready = std::chrono::steady_clock::now();
+
+            const auto t0 = std::chrono::steady_clock::now();
+            pcm_chunk spill;
+            if (queue.push(std::move(chunk), spill)) {
+                pool.reclaim(std::move(spill.pcm));
+            }
+            t_push_max = std::max(t_push_max, 1e6*std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count());
+
+            queue.flush();
+            std::this_thread::sleep_for(t_produce);
+        }
+        while (!queue.flush_wait(100)) {
+        }
+        const uint64_t n_allocs = pcm_n_allocs() - n_allocs_warm.load();
+
+        done.store(true);
+        queue.notify();
+        consumer.join();
+
+        const queue_stats qs = queue.stats();
+        printf("%12s %8llu %8llu %8llu %8llu %10zu %10llu %8llu %8.1f %10.0f\n", queue_overflow_name(policy),
+                (unsigned long long) n_items, (unsigned long long) n_markers,
+                (unsigned long long) (qs.n_dropped_old + qs.n_dropped_new + qs.n_block_drops),
+                (unsigned long long) qs.n_coalesced, n_largest, (unsigned long long) n_misplaced,
+                (unsigned long long) n_allocs, 100.0*n_samples/std::max<uint64_t>(n_produced, 1), t_push_max);
+    }
+}
@@ -0,0 +1,306 @@
+#include "session-manager.h"
+
+#include "common-whisper.h"
+
+#include <algorithm>
+#include <cstdio>
+
+// processed blocks kept for acquire(), the rest are freed
+#define SESSION_N_FREE_BLOCKS 16
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "Psapi.lib")
+#else
+#include <unistd.h>
+#endif
+
+session_manager::session_manager(whisper_context * ctx, const whisper_full_params & wparams, int n_workers, session_callback callback)
+    : m_ctx(ctx), m_wparams(wparams), m_callback(std::move(callback)) {
+    for (int i = 0; i < std::max(1, n_workers); ++i) {
+        m_workers.emplace_back(&session_manager::worker, this);
+    }
+}
+
+session_manager::~session_manager() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cv_work.notify_all();
+
+    for (auto & w : m_workers) {
+        w.join();
+    }
+
+    for (auto & s : m_sessions) {
+        if (s && s->state) {
+            whisper_free_state(s->state);
+        }
+    }
+}
+
+int session_manager::open() {
+    whisper_state * state = whisper_init_state(m_ctx);
+    if (state == nullptr) {
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_sessions.emplace_back(new session);
+    m_sessions.back()->state = state;
+
+    return (int) m_sessions.size() - 1;
+}
+
+void session_manager::close(int id) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (id < 0 || id >= (int) m_sessions.size() || m_sessions[id]->closed) {
+        return;
+    }
+
+    session & s = *m_sessions[id];
+    s.closed = true;
+    if (!s.busy && s.jobs.empty()) {
+        whisper_free_state(s.state);
+        s.state = nullptr;
+    }
+}
+
+pcm_block session_manager::acquire() {
+    pcm_block block;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_free.empty()) {
+            block = std::move(m_free.back());
+            m_free.pop_back();
+        }
+    }
+    block.clear();
+    return block;
+}
+
+void session_manager::release(pcm_block && block) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_free.size() < SESSION_N_FREE_BLOCKS) {
+        m_free.push_back(std::move(block));
+    }
+}
+
+bool session_manager::push(int id, pcm_block && samples) {
+    return push(id, std::move(samples), -1);
+}
+
+bool session_manager::push(int id, pcm_block && samples, int64_t pos) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (id < 0 || id >= (int) m_sessions.size() || m_sessions[id]->closed) {
+            return false;
+        }
+
+        session & s = *m_sessions[id];
+
+        job j;
+        j.pos    = pos < 0 ? s.n_pushed : pos;
+        j.t_push = std::chrono::steady_clock::now();
+        s.n_pushed = j.pos + (int64_t) samples.size();
+        j.samples = std::move(samples);
+
+        // a busy session is put back on the ready list by its worker
+        if (!s.busy && s.jobs.empty()) {
+            m_ready.push_back(id);
+        }
+        s.jobs.push_back(std::move(j));
+        m_n_jobs++;
+    }
+    m_cv_work.notify_one();
+
+    return true;
+}
+
+void session_manager::drain() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv_idle.wait(lock, [&] { return m_n_jobs == 0; });
+}
+
+session_stats session_manager::stats(int id) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (id < 0 || id >= (int) m_sessions.size()) {
+        return session_stats();
+    }
+    return m_sessions[id]->stats;
+}
+
+void session_manager::worker() {
+    while (true) {
+        int id = -1;
+        whisper_state * state = nullptr;
+        job j;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv_work.wait(lock, [&] { return m_stop || !m_ready.empty(); });
+            if (m_stop) {
+                return;
+            }
+
+            id = m_ready.front();
+            m_ready.pop_front();
+
+            session & s = *m_sessions[id];
+            s.busy = true;
+            state  = s.state;
+            j      = std::move(s.jobs.front());
+            s.jobs.pop_front();
+        }
+
+        const auto t_start = std::chrono::steady_clock::now();
+        const int ret = whisper_full_with_state(m_ctx, state, m_wparams, j.samples.data(), (int) j.samples.size());
+        const auto t_end = std::chrono::steady_clock::now();
+        const double t_latency_ms = std::chrono::duration<double, std::milli>(t_end - j.t_push).count();
+
+        if (ret != 0) {
+            fprintf(stderr, "%s: session %d: failed to process audio\n", __func__, id);
+        } else if (m_callback) {
+            const int n_segments = whisper_full_n_segments_from_state(state);
+            for (int i = 0; i < n_segments; ++i) {
+                session_result res;
+                res.id           = id;
+                res.t0           = j.pos + (whisper_full_get_segment_t0_from_state(state, i)*WHISPER_SAMPLE_RATE)/100;
+                res.t1           = j.pos + (whisper_full_get_segment_t1_from_state(state, i)*WHISPER_SAMPLE_RATE)/100;
+                res.text         = whisper_full_get_segment_text_from_state(state, i);
+                res.t_latency_ms = t_latency_ms;
+                m_callback(res);
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            session & s = *m_sessions[id];
+            s.busy = false;
+
+            s.stats.n_jobs++;
+            s.stats.n_samples       += j.samples.size();
+            s.stats.t_infer_ms      += std::chrono::duration<double, std::milli>(t_end - t_start).count();
+            s.stats.t_latency_max_ms = std::max(s.stats.t_latency_max_ms, t_latency_ms);
+
+            if (m_free.size() < SESSION_N_FREE_BLOCKS) {
+                m_free.push_back(std::move(j.samples));
+            }
+            if (!s.jobs.empty()) {
+                m_ready.push_back(id);
+                m_cv_work.notify_one();
+            } else if (s.closed) {
+                whisper_free_state(s.state);
+                s.state = nullptr;
+            }
+
+            if (--m_n_jobs == 0) {
+                m_cv_idle.notify_all();
+            }
+        }
+    }
+}
+
+size_t process_memory_bytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) {
+        return pmc.WorkingSetSize;
+    }
+    return 0;
+#else
+    FILE * f = fopen("/proc/self/statm", "r");
+    if (f == nullptr) {
+        return 0;
+    }
+    unsigned long n_size = 0, n_resident = 0;
+    const int n = fscanf(f, "%lu %lu", &n_size, &n_resident);
+    fclose(f);
+
+    return n == 2 ? (size_t) n_resident*sysconf(_SC_PAGESIZE) : 0;
+#endif
+}
+
+bool session_replay(whisper_context * ctx, const whisper_full_params & wparams, const std::vector<std::string> & fnames, int n_workers, int n_samples_chunk) {
+    const int n_streams = (int) fnames.size();
+
+    std::vector<std::vector<float>> streams(n_streams);
+    for (int i = 0; i < n_streams; ++i) {
+        std::vector<std::vector<float>> pcmf32s;
+        if (!read_audio_data(fnames[i], streams[i], pcmf32s, false)) {
+            fprintf(stderr, "%s: failed to read '%s'\n", __func__, fnames[i].c_str());
+            return false;
+        }
+    }
+
+    const size_t mem_model = process_memory_bytes();
+
+    std::mutex print_mutex;
+    session_manager manager(ctx, wparams, n_workers, [&](const session_result & res) {
+        std::lock_guard<std::mutex> lock(print_mutex);
+        printf("[%d %s -> %s] %s\n", res.id,
+                to_timestamp(res.t0*100/WHISPER_SAMPLE_RATE).c_str(),
+                to_timestamp(res.t1*100/WHISPER_SAMPLE_RATE).c_str(), res.text.c_str());
+    });
+
+    for (int i = 0; i < n_streams; ++i) {
+        if (manager.open() < 0) {
+            fprintf(stderr, "%s: failed to create state for session %d\n", __func__, i);
+            return false;
+        }
+    }
+
+    const size_t mem_states = process_memory_bytes();
+
+    // every chunk is pushed once its audio would have been captured
+    const auto t_start = std::chrono::steady_clock::now();
+    size_t n_max = 0;
+    for (const auto & s : streams) {
+        n_max = std::max(n_max, s.size());
+    }
+    for (size_t off = 0; off < n_max; off += n_samples_chunk) {
+        const size_t end = std::min(n_max, off + n_samples_chunk);
+        std::this_thread::sleep_until(t_start + std::chrono::milliseconds((int64_t) (1000*end/WHISPER_SAMPLE_RATE)));
+
+        for (int i = 0; i < n_streams; ++i) {
+            if (off < streams[i].size()) {
+                const size_t n = std::min(streams[i].size(), end) - off;
+                pcm_block chunk = manager.acquire();
+                chunk.assign(streams[i].begin() + off, streams[i].begin() + off + n);
+                manager.push(i, std::move(chunk));
+            }
+        }
+    }
+    manager.drain();
+
+    const double t_wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t_start).count();
+    const size_t mem_end   = process_memory_bytes();
+
+    printf("\n%s: %d streams, %d workers, chunks of %.1f sec\n\n", __func__, n_streams, manager.n_workers(), float(n_samples_chunk)/WHISPER_SAMPLE_RATE);
+    printf("%8s %10s %12s %8s %16s\n", "session", "audio sec", "infer sec", "RTF", "max latency ms");
+
+    double t_audio_total = 0.0;
+    double t_infer_total = 0.0;
+    for (int i = 0; i < n_streams; ++i) {
+        const session_stats st = manager.stats(i);
+        const double t_audio = double(streams[i].size())/WHISPER_SAMPLE_RATE;
+        t_audio_total += t_audio;
+        t_infer_total += 1e-3*st.t_infer_ms;
+        printf("%8d %10.1f %12.2f %8.3f %16.0f\n", i, t_audio, 1e-3*st.t_infer_ms,
+                t_audio > 0 ? 1e-3*st.t_infer_ms/t_audio : 0.0, st.t_latency_max_ms);
+    }
+
+    printf("\n%s: aggregate RTF %.3f (inference time / audio time), wall %.1f sec for %.1f sec of audio\n",
+            __func__, t_audio_total > 0 ? t_infer_total/t_audio_total : 0.0, 1e-3*t_wall_ms, t_audio_total);
+    printf("%s: memory: %.1f MB after model, %.1f MB per session at init, %.1f MB per session after replay\n",
+            __func__, mem_model/1e6,
+            (double(mem_states) - double(mem_model))/n_streams/1e6,
+            (double(mem_end)    - double(mem_model))/n_streams/1e6);
+
+    return true;
+}
@@ -0,0 +1,57 @@
+#define _USE_MATH_DEFINES // for M_PI
+
+#include "spectrum.h"
+
+#include <algorithm>
+#include <cmath>
+
+power_spectrum::power_spectrum(int n_fft) : m_fft(n_fft) {
+    m_hann.resize(n_fft);
+    for (int i = 0; i < n_fft; ++i) {
+        m_hann[i] = (float) (0.5*(1.0 - cos(2.0*M_PI*i/n_fft)));
+        m_window_sq += m_hann[i]*m_hann[i];
+    }
+    m_windowed.resize(n_fft);
+}
+
+void power_spectrum::compute(const float * x, float * out) {
+    const int n = n_fft();
+
+    const float * w = m_hann.data();
+    float       * y = m_windowed.data();
+    for (int i = 0; i < n; ++i) {
+        y[i] = w[i]*x[i];
+    }
+
+    m_fft.power(y, out);
+}
+
+spectral_bands::spectral_bands(int n_fft, int sample_rate) : m_n_fft(n_fft), m_n_bins(n_fft/2 + 1) {
+    m_k_lo = std::max(1, (int) ceil(300.0*n_fft/sample_rate));
+    m_k_hi = std::min(m_n_bins, (int) floor(3400.0*n_fft/sample_rate) + 1);
+}
+
+spectral_features spectral_bands::compute(const float * power, float window_sq) const {
+    // DC is left out, it carries offset and not sound
+    float e_total = 0.0f;
+    for (int k = 1; k < m_n_bins; ++k) {
+        e_total += power[k];
+    }
+
+    float e_speech = 0.0f;
+    float log_sum  = 0.0f;
+    for (int k = m_k_lo; k < m_k_hi; ++k) {
+        e_speech += power[k];
+        log_sum  += logf(power[k] + 1e-20f);
+    }
+
+    const int   n_speech = m_k_hi - m_k_lo;
+    const float mean     = e_speech/n_speech;
+
+    spectral_features res;
+    res.energy   = e_total/(0.5f*m_n_fft*window_sq);
+    res.speech   = e_total > 0.0f ? e_speech/e_total : 0.0f;
+    res.flatness = mean > 0.0f ? expf(log_sum/n_speech)/mean : 1.0f;
+
+    return res;
+}
@@ -15,8 +15,8 @@ system_audio_async::~system_audio_async() {
 bool system_audio_async::init(int /*capture_id*/, int sample_rate) {
     ma_device_config config = ma_device_config_init(ma_device_type_loopback);
     config.capture.format   = ma_format_f32;
-    config.capture.channels = 2;
-    config.sampleRate       = sample_rate;
+    config.capture.channels = 0; // the device's own layout, downmixed in the callback
+    config.sampleRate       = 0; // the device's own rate, resampled in the callback
     config.dataCallback     = [](ma_device* device, void* /*output*/, const void* input, ma_uint32 frame_count) {
         system_audio_async* audio = static_cast<system_audio_async*>(device->pUserData);
         audio->callback(static_cast<const float*>(input), frame_count);
@@ -28,8 +28,10 @@ bool system_audio_async::init(int /*capture_id*/, int sample_rate) {
         return false;
     }
 
-    m_sample_rate = m_device.sampleRate;
-    m_audio.resize((m_sample_rate * m_len_ms) / 1000);
+    m_sample_rate = sample_rate;
+    m_convert.init(m_device.sampleRate, m_device.capture.channels, sample_rate);
+    std::fprintf(stderr, "%s: loopback at %u Hz, %u channels\n", __func__, m_device.sampleRate, m_device.capture.channels);
+    m_ring.init((m_sample_rate * m_len_ms) / 1000);
     return true;
 }
 
@@ -61,22 +63,14 @@ bool system_audio_async::clear() {
         std::fprintf(stderr, "%s: not running!\n", __func__);
         return false;
     }
-    std::lock_guard<std::mutex> lock(m_mutex);
-    m_audio_pos = 0;
-    m_audio_len = 0;
+    m_ring.clear();
     return true;
 }
 
 void system_audio_async::callback(const float* input, ma_uint32 frame_count) {
     if (!m_running) return;
 
-    std::lock_guard<std::mutex> lock(m_mutex);
-    for (ma_uint32 i = 0; i < frame_count; ++i) {
-        float sample = 0.5f * (input[2 * i] + input[2 * i + 1]);
-        m_audio[m_audio_pos] = sample;
-        m_audio_pos = (m_audio_pos + 1) % m_audio.size();
-        m_audio_len = std::min(m_audio_len + 1, m_audio.size());
-    }
+    m_convert.process(input, frame_count, m_ring);
 }
 
 void system_audio_async::get(int ms, std::vector<float>& audio) {
@@ -85,24 +79,21 @@ void system_audio_async::get(int ms, std::vector<float>& audio) {
         return;
     }
 
-    std::lock_guard<std::mutex> lock(m_mutex);
-
     if (ms <= 0) {
         ms = m_len_ms;
     }
 
-    size_t n_samples = (m_sample_rate * ms) / 1000;
-    if (n_samples > m_audio_len) {
-        n_samples = m_audio_len;
-    }
+    m_ring.get((m_sample_rate * ms) / 1000, audio);
+}
 
-    audio.resize(n_samples);
-    int s0 = static_cast<int>(m_audio_pos) - static_cast<int>(n_samples);
-    if (s0 < 0) {
-        s0 += m_audio.size();
+bool system_audio_async::wait(int ms, int timeout_ms) {
+    if (!m_running) {
+        return false;
     }
-    for (size_t i = 0; i < n_samples; ++i) {
-        audio[i] = m_audio[(s0 + i) % m_audio.size()];
+
+    if (ms <= 0) {
+        ms = m_len_ms;
     }
-}
 
+    return m_ring.wait((m_sample_rate * ms) / 1000, timeout_ms);
+}
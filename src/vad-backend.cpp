@@ -0,0 +1,242 @@
+#include "vad-backend.h"
+
+#include "vad.h"
+#include "common.h"
+#include "mel.h"
+#include "whisper.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+// audio the simple backend compares the block against
+#define VAD_SIMPLE_HISTORY_MS 2000
+
+// below this mean absolute amplitude nothing is speech, vad_simple is purely relative
+#define VAD_SIMPLE_FLOOR 1e-3f
+
+// silero evaluates windows of 512 samples at 16 kHz, 16 of them are replayed as context
+#define VAD_SILERO_WINDOW  512
+#define VAD_SILERO_CONTEXT (16*VAD_SILERO_WINDOW)
+
+// nothing quieter than this is speech, whatever the floor (-60 dB)
+#define VAD_ENERGY_TH_MIN 1e-6f
+
+vad_backend_fixed::vad_backend_fixed(const vad_backend_params & params) : m_sample_rate(params.sample_rate) {
+}
+
+void vad_backend_fixed::classify(const float * samples, size_t n, std::vector<uint8_t> & active) {
+    vad_frame_activity(samples, n, m_sample_rate, active);
+}
+
+vad_backend_energy::vad_backend_energy(const vad_backend_params & params) : m_sample_rate(params.sample_rate) {
+    m_margin = powf(10.0f, 2.0f*params.vad_thold);
+
+    // same filter as high_pass_filter() in common, with state kept between blocks
+    const float rc = 1.0f/(2.0f*3.14159265f*std::max(1.0f, params.freq_thold));
+    const float dt = 1.0f/params.sample_rate;
+    m_alpha = params.freq_thold > 0.0f ? rc/(rc + dt) : 1.0f;
+}
+
+void vad_backend_energy::classify(const float * samples, size_t n, std::vector<uint8_t> & active) {
+    // without freq_thold the input is expected to be filtered at capture already
+    if (m_alpha < 1.0f) {
+        m_work.resize(n);
+        for (size_t i = 0; i < n; ++i) {
+            m_y_prev = m_alpha*(m_y_prev + samples[i] - m_x_prev);
+            m_x_prev = samples[i];
+            m_work[i] = m_y_prev;
+        }
+        samples = m_work.data();
+    }
+
+    vad_frames(samples, n, m_sample_rate, m_frames);
+
+    active.resize(m_frames.size());
+    for (size_t i = 0; i < m_frames.size(); ++i) {
+        const float floor = m_floor.update(m_frames[i].energy);
+        active[i] = vad_frame_voiced(m_frames[i], std::max(VAD_ENERGY_TH_MIN, m_margin*floor));
+    }
+}
+
+// spectral backend decision thresholds
+#define VAD_SPECTRAL_SPEECH_MIN    0.5f // share of the energy in the speech band
+#define VAD_SPECTRAL_FLATNESS_MAX  0.5f
+
+vad_backend_spectral::vad_backend_spectral(const vad_backend_params & params)
+    : m_spectrum(WHISPER_MEL_N_FFT), m_bands(WHISPER_MEL_N_FFT, params.sample_rate) {
+    m_n_frame = params.sample_rate/100;
+    m_margin  = powf(10.0f, 2.0f*params.vad_thold);
+
+    m_history.assign(WHISPER_MEL_N_FFT - m_n_frame, 0.0f);
+    m_power.resize(m_spectrum.n_bins());
+}
+
+void vad_backend_spectral::classify(const float * samples, size_t n, std::vector<uint8_t> & active) {
+    // each 10 ms frame is analysed with the 25 ms window that ends with it
+    const size_t n_hist = m_history.size();
+    m_work.assign(m_history.begin(), m_history.end());
+    m_work.insert(m_work.end(), samples, samples + n);
+
+    const size_t n_frames = n/m_n_frame;
+    active.resize(n_frames);
+    for (size_t i = 0; i < n_frames; ++i) {
+        m_spectrum.compute(m_work.data() + i*m_n_frame, m_power.data());
+        const spectral_features f = m_bands.compute(m_power.data(), m_spectrum.window_sq());
+
+        const float e_speech = f.energy*f.speech;
+        const float floor    = m_floor.update(e_speech);
+
+        active[i] = e_speech >= std::max(VAD_ENERGY_TH_MIN, m_margin*floor) &&
+                    f.speech >= VAD_SPECTRAL_SPEECH_MIN &&
+                    f.flatness <= VAD_SPECTRAL_FLATNESS_MAX;
+    }
+
+    m_history.assign(m_work.end() - n_hist, m_work.end());
+}
+
+void vad_backend_spectral::bench(int sample_rate) {
+    const size_t n = 10*(size_t) sample_rate;
+    std::vector<float> x(n);
+    uint32_t rng = 1;
+    for (size_t i = 0; i < n; ++i) {
+        rng = rng*1664525u + 1013904223u;
+        x[i] = 0.1f*sinf(2.0f*3.14159265f*220.0f*i/sample_rate) + 0.01f*(float(rng >> 8)/float(1 << 24) - 0.5f);
+    }
+
+    const size_t n_frame  = sample_rate/100;
+    const size_t n_frames = (n - WHISPER_MEL_N_FFT)/n_frame;
+    const int    n_iter   = 10;
+
+    power_spectrum spectrum(WHISPER_MEL_N_FFT);
+    std::vector<float> power(spectrum.n_bins());
+
+    auto t_start = std::chrono::steady_clock::now();
+    for (int it = 0; it < n_iter; ++it) {
+        for (size_t i = 0; i < n_frames; ++i) {
+            spectrum.compute(x.data() + i*n_frame, power.data());
+        }
+    }
+    const double t_spectrum = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t_start).count();
+
+    vad_backend_params params;
+    params.sample_rate = sample_rate;
+    vad_backend_spectral vad(params);
+    std::vector<uint8_t> active;
+
+    t_start = std::chrono::steady_clock::now();
+    for (int it = 0; it < n_iter; ++it) {
+        vad.classify(x.data(), n_frames*n_frame, active);
+    }
+    const double t_vad = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t_start).count();
+
+    printf("\n%s: %d x %d frames of %d samples\n\n", __func__, n_iter, (int) n_frames, WHISPER_MEL_N_FFT);
+    printf("%16s %12s\n", "stage", "ns / frame");
+    printf("%16s %12.0f\n", "power spectrum", t_spectrum/(n_iter*n_frames));
+    printf("%16s %12.0f\n", "spectral vad", t_vad/(n_iter*n_frames));
+}
+
+vad_backend_simple::vad_backend_simple(const vad_backend_params & params) : m_params(params) {
+    m_n_history = (size_t) params.sample_rate*VAD_SIMPLE_HISTORY_MS/1000;
+    m_history.reserve(2*m_n_history);
+}
+
+void vad_backend_simple::classify(const float * samples, size_t n, std::vector<uint8_t> & active) {
+    const size_t n_frame = m_params.sample_rate/100;
+
+    m_history.insert(m_history.end(), samples, samples + n);
+    if (m_history.size() > std::max(m_n_history, 2*n)) {
+        m_history.erase(m_history.begin(), m_history.end() - std::max(m_n_history, 2*n));
+    }
+
+    bool is_speech = false;
+
+    float level = 0.0f;
+    for (size_t i = 0; i < n; ++i) {
+        level += fabsf(samples[i]);
+    }
+    level /= std::max<size_t>(1, n);
+
+    // vad_simple filters in place and needs history beyond the block
+    if (level >= VAD_SIMPLE_FLOOR && m_history.size() > n) {
+        m_work.assign(m_history.begin(), m_history.end());
+        const int last_ms = (int) (1000*n/m_params.sample_rate);
+        is_speech = !vad_simple(m_work, m_params.sample_rate, std::max(1, last_ms), m_params.vad_thold, m_params.freq_thold, false);
+    }
+
+    active.assign(n/n_frame, is_speech ? 1 : 0);
+}
+
+vad_backend_silero::vad_backend_silero(const vad_backend_params & params) {
+    m_n_frame = params.sample_rate/100;
+    m_thold   = params.vad_thold;
+
+    whisper_vad_context_params cparams = whisper_vad_default_context_params();
+    cparams.n_threads = params.n_threads;
+    cparams.use_gpu   = false;
+
+    m_vctx = whisper_vad_init_from_file_with_params(params.model.c_str(), cparams);
+    if (m_vctx == nullptr) {
+        fprintf(stderr, "%s: failed to load VAD model '%s'\n", __func__, params.model.c_str());
+    }
+}
+
+vad_backend_silero::~vad_backend_silero() {
+    if (m_vctx) {
+        whisper_vad_free(m_vctx);
+    }
+}
+
+void vad_backend_silero::classify(const float * samples, size_t n, std::vector<uint8_t> & active) {
+    const size_t n_frames = n/m_n_frame;
+    active.assign(n_frames, 0);
+    if (n_frames == 0) {
+        return;
+    }
+
+    const size_t n_ctx = m_context.size();
+    m_work.assign(m_context.begin(), m_context.end());
+    m_work.insert(m_work.end(), samples, samples + n);
+
+    if (!whisper_vad_detect_speech(m_vctx, m_work.data(), (int) m_work.size())) {
+        fprintf(stderr, "%s: failed to run the VAD model\n", __func__);
+        return;
+    }
+
+    const int     n_probs = whisper_vad_n_probs(m_vctx);
+    const float * probs   = whisper_vad_probs(m_vctx);
+
+    // each frame takes the window its centre falls in
+    for (size_t i = 0; i < n_frames && n_probs > 0; ++i) {
+        const size_t centre = n_ctx + i*m_n_frame + m_n_frame/2;
+        const int    j      = std::min(n_probs - 1, (int) (centre/VAD_SILERO_WINDOW));
+        active[i] = probs[j] >= m_thold;
+    }
+
+    const size_t n_keep = std::min(m_work.size(), (size_t) VAD_SILERO_CONTEXT);
+    m_context.assign(m_work.end() - n_keep, m_work.end());
+}
+
+std::unique_ptr<vad_backend> vad_backend_create(const std::string & name, const vad_backend_params & params) {
+    if (name == "energy") {
+        return std::unique_ptr<vad_backend>(new vad_backend_energy(params));
+    }
+    if (name == "fixed") {
+        return std::unique_ptr<vad_backend>(new vad_backend_fixed(params));
+    }
+    if (name == "spectral") {
+        return std::unique_ptr<vad_backend>(new vad_backend_spectral(params));
+    }
+    if (name == "simple") {
+        return std::unique_ptr<vad_backend>(new vad_backend_simple(params));
+    }
+    if (name == "silero") {
+        std::unique_ptr<vad_backend_silero> res(new vad_backend_silero(params));
+        if (!res->ok()) {
+            return nullptr;
+        }
+        return res;
+    }
+    return nullptr;
+}
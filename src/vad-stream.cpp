@@ -0,0 +1,261 @@
+#include "vad-stream.h"
+
+#include "common-whisper.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <utility>
+
+vad_stream::vad_stream(const vad_stream_params & params, std::unique_ptr<vad_backend> backend) : m_backend(std::move(backend)) {
+    m_n_frame      = params.sample_rate/100;
+    m_n_pre_roll   = (size_t) params.pre_roll_ms  *params.sample_rate/1000;
+    m_n_hangover   = (size_t) params.hangover_ms  *params.sample_rate/1000;
+    m_n_min_speech = (size_t) params.min_speech_ms*params.sample_rate/1000;
+
+    if (!m_backend) {
+        vad_backend_params bparams;
+        bparams.sample_rate = params.sample_rate;
+        m_backend.reset(new vad_backend_energy(bparams));
+    }
+
+    m_hold.reserve(m_n_pre_roll + m_n_min_speech + m_n_hangover + m_n_frame);
+}
+
+void vad_stream::feed(const float * samples, size_t n, std::vector<vad_event> & events, std::vector<float> & speech) {
+    // the backend sees every whole frame of this call at once
+    m_frames.insert(m_frames.end(), samples, samples + n);
+
+    const size_t n_frames = m_frames.size()/m_n_frame;
+    if (n_frames == 0) {
+        return;
+    }
+
+    m_backend->classify(m_frames.data(), n_frames*m_n_frame, m_active);
+    for (size_t i = 0; i < n_frames; ++i) {
+        frame(m_frames.data() + i*m_n_frame, m_active[i] != 0, events, speech);
+    }
+
+    m_frames.erase(m_frames.begin(), m_frames.begin() + n_frames*m_n_frame);
+}
+
+void vad_stream::frame(const float * x, bool active, std::vector<vad_event> & events, std::vector<float> & speech) {
+    m_pos += m_n_frame;
+
+    if (m_state == state_speech) {
+        speech.insert(speech.end(), x, x + m_n_frame);
+        m_n_forwarded += m_n_frame;
+
+        m_n_gap = active ? 0 : m_n_gap + m_n_frame;
+        if (m_n_gap >= m_n_hangover) {
+            events.push_back({ vad_event::speech_end, m_pos, speech.size() });
+            m_state    = state_silence;
+            m_n_gap    = 0;
+            m_hold.clear();
+            m_hold_pos = m_pos;
+        }
+        return;
+    }
+
+    m_hold.insert(m_hold.end(), x, x + m_n_frame);
+
+    if (m_state == state_silence && active) {
+        m_state    = state_pending;
+        m_n_active = 0;
+        m_n_gap    = 0;
+    }
+
+    if (m_state == state_pending) {
+        if (active) {
+            m_n_active += m_n_frame;
+            m_n_gap     = 0;
+        } else {
+            m_n_gap += m_n_frame;
+        }
+
+        if (m_n_active >= m_n_min_speech) {
+            // region confirmed, it begins with the pre-roll kept in front of the pending audio
+            events.push_back({ vad_event::speech_start, m_hold_pos, speech.size() });
+            speech.insert(speech.end(), m_hold.begin(), m_hold.end());
+            m_n_forwarded += m_hold.size();
+            m_n_regions++;
+
+            m_state = state_speech;
+            m_n_gap = 0;
+            m_hold.clear();
+            return;
+        }
+
+        if (m_n_gap < m_n_hangover && m_hold.size() < m_n_pre_roll + m_n_min_speech + m_n_hangover) {
+            return;
+        }
+
+        // a blip or sparse clicks, not speech
+        m_state = state_silence;
+    }
+
+    // in silence only the pre-roll is kept
+    if (m_hold.size() > m_n_pre_roll) {
+        const size_t n_drop = m_hold.size() - m_n_pre_roll;
+        m_hold.erase(m_hold.begin(), m_hold.begin() + n_drop);
+        m_hold_pos += n_drop;
+    }
+}
+
+// speech intervals of a label file next to the WAV, "<name>.lab" in Audacity's label track
+// format: one "start end [text]" line per region, times in seconds
+static bool vad_read_labels(const std::string & fname, int sample_rate, std::vector<std::pair<int64_t, int64_t>> & labels) {
+    const size_t i_ext = fname.find_last_of('.');
+    const size_t i_dir = fname.find_last_of("/\\");
+    const std::string fname_lab = (i_ext != std::string::npos && (i_dir == std::string::npos || i_ext > i_dir) ?
+            fname.substr(0, i_ext) : fname) + ".lab";
+
+    std::ifstream fin(fname_lab);
+    if (!fin) {
+        return false;
+    }
+
+    labels.clear();
+    std::string line;
+    while (std::getline(fin, line)) {
+        std::istringstream ss(line);
+        double t0 = 0.0;
+        double t1 = 0.0;
+        if (ss >> t0 >> t1 && t1 > t0) {
+            labels.emplace_back((int64_t) (t0*sample_rate), (int64_t) (t1*sample_rate));
+        }
+    }
+
+    return true;
+}
+
+static bool vad_in_intervals(const std::vector<std::pair<int64_t, int64_t>> & intervals, int64_t pos) {
+    for (const auto & r : intervals) {
+        if (pos >= r.first && pos < r.second) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool vad_compare(const std::vector<std::string> & fnames, const std::vector<std::string> & backends,
+                 const vad_backend_params & bparams, const vad_stream_params & sparams) {
+    std::vector<std::vector<float>> audio(fnames.size());
+    std::vector<std::vector<std::pair<int64_t, int64_t>>> labels(fnames.size());
+    std::vector<bool> labeled(fnames.size(), false);
+
+    double t_audio   = 0.0;
+    int    n_labeled = 0;
+    for (size_t i = 0; i < fnames.size(); ++i) {
+        std::vector<std::vector<float>> pcmf32s;
+        if (!read_audio_data(fnames[i], audio[i], pcmf32s, false)) {
+            fprintf(stderr, "%s: failed to read '%s'\n", __func__, fnames[i].c_str());
+            return false;
+        }
+        t_audio += double(audio[i].size())/sparams.sample_rate;
+
+        labeled[i] = vad_read_labels(fnames[i], sparams.sample_rate, labels[i]);
+        n_labeled += labeled[i];
+    }
+
+    // blocks of the size the live loop feeds
+    const size_t n_block = (size_t) sparams.sample_rate/2;
+    const size_t n_frame = (size_t) sparams.sample_rate/100;
+
+    printf("\n%s: %d files, %.1f sec of audio, %d labeled\n\n", __func__, (int) fnames.size(), t_audio, n_labeled);
+    printf("%8s %10s %10s %8s %8s %14s %16s\n", "backend", "active %", "speech %", "prec", "recall", "triggers/min", "ns / sec audio");
+
+    std::vector<vad_event> events;
+    std::vector<float>     speech;
+    for (const auto & name : backends) {
+        uint64_t n_regions   = 0;
+        uint64_t n_forwarded = 0;
+        double   t_cpu_ns    = 0.0;
+
+        // frame decisions of the backend against the labels
+        uint64_t n_tp = 0;
+        uint64_t n_fp = 0;
+        uint64_t n_fn = 0;
+
+        // labeled speech samples and how many of them ended up in a region
+        uint64_t n_speech     = 0;
+        uint64_t n_speech_fwd = 0;
+
+        for (size_t i = 0; i < audio.size(); ++i) {
+            const auto & pcmf32 = audio[i];
+
+            std::unique_ptr<vad_backend> backend = vad_backend_create(name, bparams);
+            if (!backend) {
+                fprintf(stderr, "%s: unknown or unavailable backend '%s'\n", __func__, name.c_str());
+                return false;
+            }
+            vad_stream vad(sparams, std::move(backend));
+
+            std::vector<std::pair<int64_t, int64_t>> regions;
+            int64_t region_start = -1;
+
+            for (size_t off = 0; off < pcmf32.size(); off += n_block) {
+                events.clear();
+                speech.clear();
+
+                const int64_t pos = vad.position();
+
+                const auto t_start = std::chrono::steady_clock::now();
+                vad.feed(pcmf32.data() + off, std::min(n_block, pcmf32.size() - off), events, speech);
+                t_cpu_ns += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t_start).count();
+
+                for (const auto & e : events) {
+                    if (e.type == vad_event::speech_start) {
+                        region_start = e.pos;
+                    } else {
+                        regions.emplace_back(region_start, e.pos);
+                        region_start = -1;
+                    }
+                }
+
+                if (!labeled[i]) {
+                    continue;
+                }
+
+                // frames are judged by the label at their centre
+                const size_t n_frames = (size_t) (vad.position() - pos)/n_frame;
+                const auto & active = vad.active();
+                for (size_t j = 0; j < n_frames && j < active.size(); ++j) {
+                    const bool truth = vad_in_intervals(labels[i], pos + (int64_t) (j*n_frame + n_frame/2));
+                    n_tp += truth && active[j];
+                    n_fp += !truth && active[j];
+                    n_fn += truth && !active[j];
+                }
+            }
+            if (region_start >= 0) {
+                regions.emplace_back(region_start, vad.position());
+            }
+
+            n_regions   += vad.n_regions();
+            n_forwarded += vad.n_forwarded();
+
+            for (const auto & l : labels[i]) {
+                for (int64_t t = l.first; t < std::min(l.second, (int64_t) pcmf32.size()); t += n_frame) {
+                    const int64_t n = std::min((int64_t) n_frame, l.second - t);
+                    n_speech     += n;
+                    n_speech_fwd += vad_in_intervals(regions, t) ? n : 0;
+                }
+            }
+        }
+
+        printf("%8s %9.1f%%", name.c_str(), 100.0*n_forwarded/(t_audio*sparams.sample_rate));
+        if (n_labeled > 0) {
+            printf(" %9.1f%% %8.3f %8.3f",
+                    n_speech     > 0 ? 100.0*n_speech_fwd/n_speech : 0.0,
+                    n_tp + n_fp  > 0 ? double(n_tp)/(n_tp + n_fp)  : 0.0,
+                    n_tp + n_fn  > 0 ? double(n_tp)/(n_tp + n_fn)  : 0.0);
+        } else {
+            printf(" %10s %8s %8s", "-", "-", "-");
+        }
+        printf(" %14.2f %16.0f\n", 60.0*n_regions/t_audio, t_cpu_ns/t_audio);
+    }
+
+    return true;
+}
@@ -1,38 +1,319 @@
 #include "vad.h"
+#include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <cstdio>
 
-bool vad_detect_speech(const std::vector<float> &pcmf32, int sample_rate) {
-    if (pcmf32.empty()) {
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define VAD_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define VAD_TARGET_AVX2
+#else
+#define VAD_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#elif defined(__ARM_NEON) || defined(__aarch64__) || defined(_M_ARM64)
+#define VAD_NEON
+#include <arm_neon.h>
+#endif
+
+// Simple heuristics: voice has enough energy and moderate zero crossings
+#define VAD_ENERGY_TH 1e-4f // around -40 dB
+#define VAD_ZCR_MIN   0.005f
+#define VAD_ZCR_MAX   0.3f
+
+// Sum of squares of x[0..n) and the number of sign changes between x[i] and x[i + 1] for
+// i in [0, n - 1). A sign change is (x >= 0) != (prev >= 0), as in the original loop.
+typedef void (*vad_kernel_t)(const float * x, int n, float * sum_sq, int * n_crossings);
+
+static void vad_kernel_scalar(const float * x, int n, float * sum_sq, int * n_crossings) {
+    float e = 0.0f;
+    int   c = 0;
+    for (int i = 0; i < n; ++i) {
+        e += x[i]*x[i];
+    }
+    for (int i = 0; i + 1 < n; ++i) {
+        c += (x[i] >= 0.0f) != (x[i + 1] >= 0.0f);
+    }
+    *sum_sq      = e;
+    *n_crossings = c;
+}
+
+#ifdef VAD_X86
+static void vad_kernel_sse2(const float * x, int n, float * sum_sq, int * n_crossings) {
+    const __m128 zero = _mm_setzero_ps();
+
+    __m128  acc = _mm_setzero_ps();
+    __m128i cnt = _mm_setzero_si128();
+
+    // a covers x[i..i+4), b the next sample of each lane; the crossing masks are all ones,
+    // subtracting them counts them
+    int i = 0;
+    for (; i + 5 <= n; i += 4) {
+        const __m128 a = _mm_loadu_ps(x + i);
+        const __m128 b = _mm_loadu_ps(x + i + 1);
+        acc = _mm_add_ps(acc, _mm_mul_ps(a, a));
+        const __m128 m = _mm_xor_ps(_mm_cmpge_ps(a, zero), _mm_cmpge_ps(b, zero));
+        cnt = _mm_sub_epi32(cnt, _mm_castps_si128(m));
+    }
+
+    float e4[4];
+    int   c4[4];
+    _mm_storeu_ps(e4, acc);
+    _mm_storeu_si128((__m128i *) c4, cnt);
+
+    float e = (e4[0] + e4[1]) + (e4[2] + e4[3]);
+    int   c = c4[0] + c4[1] + c4[2] + c4[3];
+    for (int j = i; j < n; ++j) {
+        e += x[j]*x[j];
+    }
+    for (int j = i; j + 1 < n; ++j) {
+        c += (x[j] >= 0.0f) != (x[j + 1] >= 0.0f);
+    }
+    *sum_sq      = e;
+    *n_crossings = c;
+}
+
+VAD_TARGET_AVX2
+static void vad_kernel_avx2(const float * x, int n, float * sum_sq, int * n_crossings) {
+    const __m256 zero = _mm256_setzero_ps();
+
+    __m256  acc = _mm256_setzero_ps();
+    __m256i cnt = _mm256_setzero_si256();
+
+    int i = 0;
+    for (; i + 9 <= n; i += 8) {
+        const __m256 a = _mm256_loadu_ps(x + i);
+        const __m256 b = _mm256_loadu_ps(x + i + 1);
+        acc = _mm256_add_ps(acc, _mm256_mul_ps(a, a));
+        const __m256 m = _mm256_xor_ps(_mm256_cmp_ps(a, zero, _CMP_GE_OQ), _mm256_cmp_ps(b, zero, _CMP_GE_OQ));
+        cnt = _mm256_sub_epi32(cnt, _mm256_castps_si256(m));
+    }
+
+    float e8[8];
+    int   c8[8];
+    _mm256_storeu_ps(e8, acc);
+    _mm256_storeu_si256((__m256i *) c8, cnt);
+
+    float e = ((e8[0] + e8[1]) + (e8[2] + e8[3])) + ((e8[4] + e8[5]) + (e8[6] + e8[7]));
+    int   c = c8[0] + c8[1] + c8[2] + c8[3] + c8[4] + c8[5] + c8[6] + c8[7];
+    for (int j = i; j < n; ++j) {
+        e += x[j]*x[j];
+    }
+    for (int j = i; j + 1 < n; ++j) {
+        c += (x[j] >= 0.0f) != (x[j + 1] >= 0.0f);
+    }
+    *sum_sq      = e;
+    *n_crossings = c;
+}
+
+static bool vad_cpu_has_avx2() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+        return false;
+    }
+    __cpuid(info, 1);
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx     = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) {
         return false;
     }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
 
-    // Calculate short-term energy and zero-crossing rate
-    float energy = 0.0f;
-    int crossings = 0;
-    for (size_t i = 0; i < pcmf32.size(); ++i) {
-        float s = pcmf32[i];
-        energy += s * s;
+#ifdef VAD_NEON
+static void vad_kernel_neon(const float * x, int n, float * sum_sq, int * n_crossings) {
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+
+    float32x4_t acc = vdupq_n_f32(0.0f);
+    uint32x4_t  cnt = vdupq_n_u32(0);
+
+    int i = 0;
+    for (; i + 5 <= n; i += 4) {
+        const float32x4_t a = vld1q_f32(x + i);
+        const float32x4_t b = vld1q_f32(x + i + 1);
+        acc = vmlaq_f32(acc, a, a);
+        cnt = vsubq_u32(cnt, veorq_u32(vcgeq_f32(a, zero), vcgeq_f32(b, zero)));
+    }
+
+    float e = vaddvq_f32(acc);
+    int   c = (int) vaddvq_u32(cnt);
+    for (int j = i; j < n; ++j) {
+        e += x[j]*x[j];
+    }
+    for (int j = i; j + 1 < n; ++j) {
+        c += (x[j] >= 0.0f) != (x[j + 1] >= 0.0f);
+    }
+    *sum_sq      = e;
+    *n_crossings = c;
+}
+#endif
+
+struct vad_kernel_info {
+    const char * name;
+    vad_kernel_t fn;
+};
+
+// available kernels, best first
+static std::vector<vad_kernel_info> vad_kernels() {
+    std::vector<vad_kernel_info> res;
+#ifdef VAD_X86
+    if (vad_cpu_has_avx2()) {
+        res.push_back({ "avx2", vad_kernel_avx2 });
+    }
+    res.push_back({ "sse2", vad_kernel_sse2 });
+#endif
+#ifdef VAD_NEON
+    res.push_back({ "neon", vad_kernel_neon });
+#endif
+    res.push_back({ "scalar", vad_kernel_scalar });
+    return res;
+}
+
+static const vad_kernel_info & vad_kernel_best() {
+    static const vad_kernel_info best = vad_kernels().front();
+    return best;
+}
+
+static void vad_frames_impl(vad_kernel_t kernel, const float * samples, size_t n, int sample_rate, std::vector<vad_frame> & frames) {
+    const size_t n_frame = sample_rate/100;
+
+    frames.clear();
+    for (size_t i = 0; i < n; i += n_frame) {
+        vad_frame f;
+        f.n_samples = (int) std::min(n_frame, n - i);
+
+        kernel(samples + i, f.n_samples, &f.energy, &f.n_crossings);
+        f.energy /= f.n_samples;
+
+        // crossing from the last sample of the previous frame
         if (i > 0) {
-            float prev = pcmf32[i - 1];
-            if ((s >= 0 && prev < 0) || (s < 0 && prev >= 0)) {
-                crossings++;
+            f.n_crossings += (samples[i - 1] >= 0.0f) != (samples[i] >= 0.0f);
+        }
+
+        frames.push_back(f);
+    }
+}
+
+void vad_frames(const float * samples, size_t n, int sample_rate, std::vector<vad_frame> & frames) {
+    vad_frames_impl(vad_kernel_best().fn, samples, n, sample_rate, frames);
+}
+
+bool vad_frame_voiced(const vad_frame & frame, float energy_th) {
+    const float zcr = float(frame.n_crossings)/frame.n_samples;
+    return frame.energy >= energy_th && zcr >= VAD_ZCR_MIN && zcr <= VAD_ZCR_MAX;
+}
+
+void vad_frame_activity(const float * samples, size_t n, int sample_rate, std::vector<uint8_t> & active) {
+    std::vector<vad_frame> frames;
+    vad_frames(samples, n, sample_rate, frames);
+
+    active.resize(frames.size());
+    for (size_t i = 0; i < frames.size(); ++i) {
+        active[i] = vad_frame_voiced(frames[i], VAD_ENERGY_TH);
+    }
+}
+
+// the minimum of a noisy energy sits below its mean
+#define VAD_NOISE_BIAS   1.5f
+#define VAD_NOISE_SMOOTH 0.8f
+
+vad_noise_floor::vad_noise_floor(int n_frames, int n_windows)
+    : m_n_frames(n_frames), m_cur_min(INFINITY), m_mins(n_windows, INFINITY) {
+}
+
+float vad_noise_floor::update(float energy) {
+    m_smooth = m_smooth < 0.0f ? energy : VAD_NOISE_SMOOTH*m_smooth + (1.0f - VAD_NOISE_SMOOTH)*energy;
+    m_cur_min = std::min(m_cur_min, m_smooth);
+
+    if (++m_n_in_window == m_n_frames) {
+        m_mins[m_i_window] = m_cur_min;
+        m_i_window    = (m_i_window + 1) % (int) m_mins.size();
+        m_n_in_window = 0;
+        m_cur_min     = INFINITY;
+    }
+
+    float res = m_cur_min;
+    for (float m : m_mins) {
+        res = std::min(res, m);
+    }
+    m_floor = VAD_NOISE_BIAS*res;
+
+    return m_floor;
+}
+
+const char * vad_kernel_name() {
+    return vad_kernel_best().name;
+}
+
+void vad_bench(int sample_rate) {
+    // 60 s of a voiced-like tone in noise
+    const size_t n = 60*(size_t) sample_rate;
+    std::vector<float> x(n);
+    uint32_t rng = 1;
+    for (size_t i = 0; i < n; ++i) {
+        rng = rng*1664525u + 1013904223u;
+        x[i] = 0.1f*sinf(2.0f*3.14159265f*220.0f*i/sample_rate) + 0.01f*(float(rng >> 8)/float(1 << 24) - 0.5f);
+    }
+
+    const int n_iter = 20;
+
+    std::vector<vad_frame> frames;
+    std::vector<vad_frame> ref;
+    vad_frames_impl(vad_kernel_scalar, x.data(), n, sample_rate, ref);
+
+    printf("\n%s: %d x 60 sec of audio, %d frames\n\n", __func__, n_iter, (int) ref.size());
+    printf("%8s %16s %10s\n", "kernel", "ns / sec audio", "max diff");
+    for (const auto & k : vad_kernels()) {
+        const auto t_start = std::chrono::steady_clock::now();
+        for (int i = 0; i < n_iter; ++i) {
+            vad_frames_impl(k.fn, x.data(), n, sample_rate, frames);
+        }
+        const double t_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t_start).count();
+
+        float max_diff = 0.0f;
+        for (size_t i = 0; i < frames.size(); ++i) {
+            max_diff = std::max(max_diff, std::fabs(frames[i].energy - ref[i].energy));
+            if (frames[i].n_crossings != ref[i].n_crossings) {
+                max_diff = INFINITY;
             }
         }
+
+        printf("%8s %16.0f %10.2e\n", k.name, t_ns/(60.0*n_iter), max_diff);
+    }
+}
+
+bool vad_detect_speech(const std::vector<float> &pcmf32, int sample_rate) {
+    if (pcmf32.empty()) {
+        return false;
+    }
+
+    std::vector<vad_frame> frames;
+    vad_frames(pcmf32.data(), pcmf32.size(), sample_rate, frames);
+
+    // Calculate short-term energy and zero-crossing rate of the whole chunk
+    double energy = 0.0;
+    int crossings = 0;
+    for (const auto & f : frames) {
+        energy    += double(f.energy)*f.n_samples;
+        crossings += f.n_crossings;
     }
     energy /= pcmf32.size();
     float zcr = static_cast<float>(crossings) / pcmf32.size();
 
-    // Simple heuristics: voice has enough energy and moderate zero crossings
-    const float energy_th = 1e-4f; // around -40 dB
-    const float zcr_min = 0.005f;
-    const float zcr_max = 0.3f;
-
-    if (energy < energy_th) {
+    if (energy < VAD_ENERGY_TH) {
         return false;
     }
-    if (zcr < zcr_min || zcr > zcr_max) {
+    if (zcr < VAD_ZCR_MIN || zcr > VAD_ZCR_MAX) {
         return false;
     }
     return true;
 }
-
@@ -0,0 +1,57 @@
+#include "wait-event.h"
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#pragma comment(lib, "Synchronization.lib")
+#elif defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <ctime>
+#else
+#include <chrono>
+#include <thread>
+#endif
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "wait_event requires a lock-free 32-bit atomic");
+
+void wait_event::wait(uint32_t seq, int timeout_ms) {
+    if (timeout_ms <= 0) {
+        return;
+    }
+
+    m_n_waiters.fetch_add(1, std::memory_order_seq_cst);
+
+    if (m_seq.load(std::memory_order_seq_cst) == seq) {
+#if defined(_WIN32)
+        WaitOnAddress(&m_seq, &seq, sizeof(seq), (DWORD) timeout_ms);
+#elif defined(__linux__)
+        struct timespec ts;
+        ts.tv_sec  = timeout_ms / 1000;
+        ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+        syscall(SYS_futex, reinterpret_cast<uint32_t *>(&m_seq), FUTEX_WAIT_PRIVATE, seq, &ts, nullptr, 0);
+#else
+        // no futex available - degrade to a short sleep, callers re-check their condition
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+#endif
+    }
+
+    m_n_waiters.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void wait_event::notify() {
+    m_seq.fetch_add(1, std::memory_order_seq_cst);
+
+    if (m_n_waiters.load(std::memory_order_seq_cst) == 0) {
+        return;
+    }
+
+#if defined(_WIN32)
+    WakeByAddressAll(&m_seq);
+#elif defined(__linux__)
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(&m_seq), FUTEX_WAKE_PRIVATE, INT32_MAX, nullptr, nullptr, 0);
+#endif
+}